@@ -0,0 +1,181 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "batchgcd.h"
+#include "keyfile.h"
+#include "numtheory.h"
+#include "store.h"
+#include "tool.h"
+#include "tune.h"
+
+// The moduli being audited, and a name for each to report it by.
+typedef struct {
+    mpz_t *n;
+    char **names;
+    uint64_t count;
+    uint64_t cap;
+} key_set;
+
+// Helper function to add the modulus of key to set under name.
+void add_modulus(key_set *set, rsa_key *key, const char *name) {
+    if (set->count == set->cap) {
+        set->cap = set->cap != 0 ? 2 * set->cap : 64;
+        set->n = realloc(set->n, set->cap * sizeof(mpz_t));
+        set->names = realloc(set->names, set->cap * sizeof(char *));
+    }
+    mpz_init_set(set->n[set->count], key->n);
+    set->names[set->count] = strdup(name);
+    set->count += 1;
+}
+
+// Helper function to add every key in the key store dir to set.
+//
+// Returns true if every key was read, false if the store or any key
+// couldn't be.
+bool add_store(key_set *set, const char *dir) {
+    store_entry *entries;
+    size_t count;
+    if (store_entries(dir, &entries, &count) == false) {
+        fprintf(stderr, "Unable to read key store %s.\n", dir);
+        return false;
+    }
+    bool ok = true;
+
+    for (size_t i = 0; i < count; i++) {
+        rsa_key key;
+        if (store_read_key(dir, entries[i].fingerprint, &key) == false) {
+            fprintf(stderr, "Unable to read %s from %s.\n", entries[i].fingerprint, dir);
+            ok = false;
+            continue;
+        }
+        char name[KEY_USER_MAX + 32];
+        snprintf(name, sizeof(name), "%s (%.16s)", entries[i].username, entries[i].fingerprint);
+        add_modulus(set, &key, name);
+        key_clear(&key);
+    }
+
+    free(entries);
+    return ok;
+}
+
+// Main function. Takes input from the command line.
+// Returns 0 if no weak keys were found, 1 otherwise.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    bool verbose = false;
+    uint64_t nthreads = 0;
+    key_set set = { NULL, NULL, 0, 0 };
+
+    // Shared setup: the memory pool and the tuning file.
+    tool_init(false);
+
+    // Parse command line options. Key stores are read as they are given;
+    // key files are named after the options.
+    while ((opt = getopt(argc, argv, "hvk:t:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Finds public keys whose moduli share a prime with another "
+                   "key.\n\nUSAGE\n   ./audit [-hv] [-k store] [-t threads] [pbfile...]\n\n"
+                   "OPTIONS\n   -h              Display program help and usage.\n   -v         "
+                   "     Display verbose program output.\n   -k store        Audit every key in "
+                   "a key store.\n   -t threads      Threads used for the trees (default: "
+                   "tuned, or online CPUs).\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'k':
+            if (add_store(&set, optarg) == false) {
+                return 1;
+            }
+            break;
+        case 't': nthreads = strtoull(optarg, NULL, 10); break;
+        }
+    }
+
+    for (int i = optind; i < argc; i++) {
+        FILE *pbfile = fopen(argv[i], "r");
+        if (pbfile == NULL) {
+            perror("Failed");
+            return 1;
+        }
+        rsa_key key;
+        bool ok = key_read(&key, pbfile);
+        fclose(pbfile);
+        if (ok == false) {
+            fprintf(stderr, "Unable to read key %s.\n", argv[i]);
+            return 1;
+        }
+        add_modulus(&set, &key, argv[i]);
+        key_clear(&key);
+    }
+
+    // The trees are sized by the moduli, so use the threads tuned for them.
+    if (nthreads == 0) {
+        nthreads = tune_lookup(set.count > 0 ? mpz_sizeinbase(set.n[0], 2) : 0).threads;
+    }
+    if (verbose == true) {
+        printf("auditing %" PRIu64 " moduli on %" PRIu64 " threads\n", set.count, nthreads);
+    }
+
+    // Batch GCD of every modulus with the product of all the others.
+    mpz_t *gcds = calloc(set.count + 1, sizeof(mpz_t));
+    for (uint64_t i = 0; i < set.count; i++) {
+        mpz_init(gcds[i]);
+    }
+    if (batch_gcd(gcds, set.n, set.count, nthreads) == false) {
+        fprintf(stderr, "Unable to spill the product tree.\n");
+        return 1;
+    }
+
+    // Weak keys are rare, so the keys sharing each one's primes are found
+    // by checking the weak keys against each other directly.
+    uint64_t *weak = calloc(set.count + 1, sizeof(uint64_t));
+    uint64_t nweak = 0;
+    for (uint64_t i = 0; i < set.count; i++) {
+        if (mpz_cmp_ui(gcds[i], 1) != 0) {
+            weak[nweak++] = i;
+        }
+    }
+
+    mpz_t f;
+    mpz_init(f);
+    for (uint64_t a = 0; a < nweak; a++) {
+        uint64_t i = weak[a];
+        for (uint64_t b = 0; b < nweak; b++) {
+            uint64_t j = weak[b];
+            if (i == j) {
+                continue;
+            }
+            gcd(f, set.n[i], set.n[j]);
+            if (mpz_cmp(f, set.n[i]) == 0) {
+                printf("weak: %s has the same modulus as %s\n", set.names[i], set.names[j]);
+            } else if (mpz_cmp_ui(f, 1) != 0) {
+                printf("weak: %s shares a prime with %s\n", set.names[i], set.names[j]);
+                if (verbose == true) {
+                    gmp_printf("      p = %Zx\n", f);
+                }
+            }
+        }
+    }
+    if (verbose == true || nweak > 0) {
+        printf("%" PRIu64 " of %" PRIu64 " keys are weak\n", nweak, set.count);
+    }
+
+    // Termination.
+    for (uint64_t i = 0; i < set.count; i++) {
+        mpz_clears(set.n[i], gcds[i], NULL);
+        free(set.names[i]);
+    }
+    mpz_clear(f);
+    free(set.n);
+    free(set.names);
+    free(gcds);
+    free(weak);
+    return nweak > 0 ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "batchgcd.h"
+#include "jobs.h"
+#include "numtheory.h"
+#include "pool.h"
+
+// The steps run over every node of one level of the trees.
+typedef enum { STEP_PRODUCT, STEP_REMAINDER, STEP_LEAF } tree_step;
+
+// One worker's share of a level. Worker t handles nodes t, t + stride,
+// t + 2 * stride and so on, so every worker gets some of the large
+// nodes near the end of an unevenly sized level.
+typedef struct {
+    tree_step step;
+    mpz_t *below; // Level below, for STEP_PRODUCT.
+    uint64_t nbelow;
+    mpz_t *above; // Remainders of the level above, for the other steps.
+    mpz_t *prod; // Products of this level, for the other steps.
+    mpz_t *out;
+    uint64_t count;
+    uint64_t first;
+    uint64_t stride;
+} level_job;
+
+// Function to run one worker's share of a level.
+//
+// A product node is the product of its two children, or a copy of its
+// only child at the end of an odd level. A remainder node is the
+// remainder of its parent modulo the square of its own product. A leaf
+// takes the remainder for its modulus n, R = P mod n^2, and finds
+// gcd(R / n, n), which is gcd(n, P / n) without ever forming P / n.
+static void *batch_gcd_worker(void *arg) {
+    level_job *job = arg;
+    mpz_t sq, r;
+    mpz_inits(sq, r, NULL);
+
+    for (uint64_t j = job->first; j < job->count; j += job->stride) {
+        switch (job->step) {
+        case STEP_PRODUCT:
+            if (2 * j + 1 < job->nbelow) {
+                mpz_mul(job->out[j], job->below[2 * j], job->below[2 * j + 1]);
+            } else {
+                mpz_set(job->out[j], job->below[2 * j]);
+            }
+            break;
+        case STEP_REMAINDER:
+            mpz_mul(sq, job->prod[j], job->prod[j]);
+            mpz_mod(job->out[j], job->above[j / 2], sq);
+            break;
+        case STEP_LEAF:
+            mpz_mul(sq, job->prod[j], job->prod[j]);
+            mpz_mod(r, job->above[j / 2], sq);
+            mpz_divexact(r, r, job->prod[j]);
+            gcd(job->out[j], r, job->prod[j]);
+            break;
+        }
+    }
+
+    mpz_clears(sq, r, NULL);
+    pool_thread_release();
+    return NULL;
+}
+
+// Function to run a step over all count nodes of a level, across
+// nthreads threads.
+static void batch_gcd_level(level_job *base, uint64_t count, uint64_t nthreads) {
+    if (nthreads > count) {
+        nthreads = count;
+    }
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+
+    level_job *jobs = calloc(nthreads, sizeof(level_job));
+    for (uint64_t t = 0; t < nthreads; t++) {
+        jobs[t] = *base;
+        jobs[t].count = count;
+        jobs[t].first = t;
+        jobs[t].stride = nthreads;
+    }
+    run_jobs(batch_gcd_worker, jobs, nthreads, sizeof(level_job));
+    free(jobs);
+}
+
+// Function to allocate and initialize a level of count values.
+static mpz_t *batch_gcd_alloc(uint64_t count) {
+    mpz_t *level = calloc(count, sizeof(mpz_t));
+    for (uint64_t i = 0; i < count; i++) {
+        mpz_init(level[i]);
+    }
+    return level;
+}
+
+static void batch_gcd_free(mpz_t *level, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        mpz_clear(level[i]);
+    }
+    free(level);
+}
+
+// Function to compute, for every modulus, its gcd with the product of
+// all the others, using Bernstein's batch GCD. A product tree is built
+// up from the moduli, then a remainder tree is taken back down it, so
+// the work is quasi-linear in the total size of the moduli rather than
+// quadratic in their number.
+//
+// Only the levels being worked on are held in memory. Each product
+// level is spilled to a temporary file once the level above it is
+// built, and read back when the remainder tree reaches it. A gcd of 1
+// means the modulus shares no prime with any other; a gcd of n means it
+// shares both of its primes, such as when the same modulus appears twice.
+//
+// Returns true on success, false if a level couldn't be spilled.
+bool batch_gcd(mpz_t gcds[], mpz_t moduli[], uint64_t count, uint64_t nthreads) {
+    if (count == 0) {
+        return true;
+    }
+
+    // Count the levels; level 0 is the moduli, and the top is one node.
+    uint64_t levels = 1;
+    for (uint64_t n = count; n > 1; n = (n + 1) / 2) {
+        levels += 1;
+    }
+    uint64_t *sizes = calloc(levels, sizeof(uint64_t));
+    FILE **spill = calloc(levels, sizeof(FILE *));
+    sizes[0] = count;
+    for (uint64_t l = 1; l < levels; l++) {
+        sizes[l] = (sizes[l - 1] + 1) / 2;
+    }
+
+    // Product tree. Levels between the moduli and the top are spilled.
+    bool ok = true;
+    mpz_t *below = moduli;
+    for (uint64_t l = 1; l < levels; l++) {
+        mpz_t *level = batch_gcd_alloc(sizes[l]);
+        level_job job = { STEP_PRODUCT, below, sizes[l - 1], NULL, NULL, level, 0, 0, 0 };
+        batch_gcd_level(&job, sizes[l], nthreads);
+
+        if (l > 1) {
+            spill[l - 1] = tmpfile();
+            ok = ok == true && spill[l - 1] != NULL;
+            for (uint64_t j = 0; ok == true && j < sizes[l - 1]; j++) {
+                ok = mpz_out_raw(spill[l - 1], below[j]) != 0;
+            }
+            batch_gcd_free(below, sizes[l - 1]);
+        }
+        below = level;
+    }
+
+    // Remainder tree, from the product at the top down to the leaves.
+    mpz_t *above = below;
+    uint64_t nabove = sizes[levels - 1];
+    for (uint64_t l = levels - 1; ok == true && l > 1; l--) {
+        mpz_t *prod = batch_gcd_alloc(sizes[l - 1]);
+        rewind(spill[l - 1]);
+        for (uint64_t j = 0; ok == true && j < sizes[l - 1]; j++) {
+            ok = mpz_inp_raw(prod[j], spill[l - 1]) != 0;
+        }
+        fclose(spill[l - 1]);
+        spill[l - 1] = NULL;
+
+        mpz_t *level = batch_gcd_alloc(sizes[l - 1]);
+        level_job job = { STEP_REMAINDER, NULL, 0, above, prod, level, 0, 0, 0 };
+        if (ok == true) {
+            batch_gcd_level(&job, sizes[l - 1], nthreads);
+        }
+        batch_gcd_free(above, nabove);
+        batch_gcd_free(prod, sizes[l - 1]);
+        above = level;
+        nabove = sizes[l - 1];
+    }
+
+    if (ok == true && levels > 1) {
+        level_job job = { STEP_LEAF, NULL, 0, above, moduli, gcds, 0, 0, 0 };
+        batch_gcd_level(&job, count, nthreads);
+    } else if (ok == true) {
+        mpz_set_ui(gcds[0], 1);
+    }
+
+    // A failed spill leaves the rest of the levels to be released.
+    if (above != moduli) {
+        for (uint64_t l = 1; l < levels; l++) {
+            if (spill[l] != NULL) {
+                fclose(spill[l]);
+            }
+        }
+        batch_gcd_free(above, nabove);
+    }
+    free(sizes);
+    free(spill);
+    return ok;
+}
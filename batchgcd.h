@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <gmp.h>
+
+bool batch_gcd(mpz_t gcds[], mpz_t moduli[], uint64_t count, uint64_t nthreads);
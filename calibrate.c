@@ -0,0 +1,76 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "tool.h"
+#include "tune.h"
+
+// Main function. Takes input from the command line.
+// Returns 0 upon successful run.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    bool verbose = false;
+    uint64_t maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    char *path = getenv(TUNE_ENV) != NULL ? getenv(TUNE_ENV) : TUNE_FILE;
+    tune_entry entries[TUNE_MAX_ENTRIES];
+    uint64_t sizes[TUNE_MAX_ENTRIES] = { 1024, 2048, 3072, 4096 };
+    uint64_t nsizes = 0;
+
+    // Parse command line options.
+    while ((opt = getopt(argc, argv, "hvb:t:o:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Measures the fastest settings for each key size on this machine"
+                   "\n   and writes them to the tuning file the other programs read.\n\nUSAGE\n "
+                   "  ./calibrate [-hv] [-b bits] [-t threads] [-o tunefile]\n\nOPTIONS\n   -h  "
+                   "            Display program help and usage.\n   -v              Display "
+                   "verbose program output.\n   -b bits         Modulus size to calibrate (may "
+                   "be repeated,\n                   default: 1024, 2048, 3072 and 4096).\n   -t "
+                   "threads      Most worker threads to try (default: online CPUs).\n   -o "
+                   "tunefile     Tuning file to write (default: $RSA_TUNE or rsa.tune).\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'b':
+            if (nsizes < TUNE_MAX_ENTRIES) {
+                sizes[nsizes++] = strtoull(optarg, NULL, 10);
+            }
+            break;
+        case 't': maxthreads = strtoull(optarg, NULL, 10); break;
+        case 'o': path = optarg; break;
+        }
+    }
+
+    // Shared setup: the memory pool and the tuning file.
+    tool_init(false);
+
+    if (nsizes == 0) {
+        nsizes = 4;
+    }
+    if (maxthreads == 0) {
+        maxthreads = 1;
+    }
+
+    // Calibration, one modulus size at a time.
+    for (uint64_t i = 0; i < nsizes; i++) {
+        if (sizes[i] < 64) {
+            fprintf(stderr, "Modulus size must be at least 64 bits.\n");
+            return 1;
+        }
+        if (tune_calibrate(&entries[i], sizes[i], maxthreads, verbose) == false) {
+            fprintf(stderr, "Unable to calibrate %" PRIu64 " bit moduli.\n", sizes[i]);
+            return 1;
+        }
+        printf("%" PRIu64 " bits: window %" PRIu64 ", %" PRIu64 " threads, %" PRIu64
+               " byte buffers\n",
+            entries[i].bits, entries[i].window, entries[i].threads, entries[i].bufsize);
+    }
+
+    if (tune_save(path, entries, nsizes) == false) {
+        perror("Failed");
+        return 1;
+    }
+}
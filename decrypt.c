@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,9 +6,13 @@
 #include <sys/stat.h>
 #include <gmp.h>
 
+#include "keyfile.h"
+#include "lz.h"
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "tool.h"
+#include "tune.h"
 
 // Helper function for bit calculation
 void bits_num(mpz_t bit, mpz_t n) {
@@ -31,6 +36,13 @@ void bits_num(mpz_t bit, mpz_t n) {
 int main(int argc, char **argv) {
     int opt = 0;
     bool verbose = false;
+    bool ranged = false;
+    bool sharded = false;
+    uint64_t shard_index = 0;
+    uint64_t shard_count = 0;
+    bool lock = false;
+    uint64_t start = 0;
+    uint64_t len = 0;
     bool gotprvfile = false;
     bool gotinfile = false;
     bool gotoutfile = false;
@@ -39,7 +51,7 @@ int main(int argc, char **argv) {
     FILE *outfile;
 
     // Parse command line options.
-    while ((opt = getopt(argc, argv, "hvi:o:n:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvli:o:n:r:S:R:")) != -1) {
         switch (opt) {
         case 'h':
             printf("SYNOPSIS\n   Decrypts data using RSA decryption.\n   Encrypted data is "
@@ -48,9 +60,39 @@ int main(int argc, char **argv) {
                    "help and usage.\n   -v              Display verbose program output.\n   -i "
                    "infile       Input file of data to decrypt (default: stdin).\n   -o outfile    "
                    "  Output file for decrypted data (default: stdout).\n   -d pvfile       "
-                   "Private key file (default: rsa.priv).\n");
+                   "Private key file (default: rsa.priv).\n   -r start:len    Decrypt only len bytes "
+                   "from offset start\n                   (needs a file from encrypt -x).\n   -S i/N          "
+                   "Decrypt only shard i of N of the input, for\n                   the merge "
+                   "program to join.\n   -R start:len    Decrypt only the blocks starting in len "
+                   "bytes of\n                   the input from offset start, as a shard for "
+                   "the\n                   merge program.\n   -l              "
+                   "Lock key material in memory.\n");
             return 1;
         case 'v': verbose = true; break;
+        case 'l': lock = true; break;
+        case 'r':
+            if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &start, &len) != 2) {
+                fprintf(stderr, "Range must be given as start:len.\n");
+                return 1;
+            }
+            ranged = true;
+            break;
+        case 'S':
+            if (sscanf(optarg, "%" SCNu64 "/%" SCNu64, &shard_index, &shard_count) != 2
+                || shard_index >= shard_count) {
+                fprintf(stderr, "Shard must be given as i/N, with i less than N.\n");
+                return 1;
+            }
+            sharded = true;
+            break;
+        case 'R':
+            if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &start, &len) != 2) {
+                fprintf(stderr, "Range must be given as start:len.\n");
+                return 1;
+            }
+            shard_count = 0;
+            sharded = true;
+            break;
         case 'i':
             infile = fopen(optarg, "r");
             if (infile == NULL) {
@@ -78,9 +120,19 @@ int main(int argc, char **argv) {
         }
     }
 
+    // Shared setup: the memory pool, locked if requested since it will
+    // hold the private key, and the tuning file.
+    if (tool_init(lock) == false) {
+        return 1;
+    }
+
     // Open the key files if they were not opened in getopt().
     if (gotprvfile == false) {
         pvfile = fopen("rsa.priv", "r");
+        if (pvfile == NULL) {
+            perror("Failed");
+            return 1;
+        }
     }
     if (gotinfile == false) {
         infile = stdin;
@@ -89,27 +141,72 @@ int main(int argc, char **argv) {
         outfile = stdout;
     }
 
-    // Read the key.
-    mpz_t n, d;
-    mpz_inits(n, d, NULL);
+    // Read the key. Binary keys are mapped rather than parsed.
+    rsa_key key;
+    if (key_read(&key, pvfile) == false || key.priv == false) {
+        fprintf(stderr, "Unable to read private key.\n");
+        return 1;
+    }
 
-    rsa_read_priv(n, d, pvfile);
+    // Apply the tuned settings for this key size. Nothing has been read
+    // from or written to the files yet, so their buffers can be resized.
+    tune_entry tune = tune_apply(key.nbits);
+    tune_buffer(infile, &tune);
+    if (gotoutfile == true) {
+        tune_buffer(outfile, &tune);
+    }
 
     // Print stats if verbose.
     if (verbose == true) {
         mpz_t bit;
         mpz_init(bit);
 
-        bits_num(bit, n);
-        gmp_printf("n (%Zd bits) = %Zd\n", bit, n);
-        bits_num(bit, d);
-        gmp_printf("d (%Zd bits) = %Zd\n", bit, d);
+        bits_num(bit, key.n);
+        gmp_printf("n (%Zd bits) = %Zd\n", bit, key.n);
+        bits_num(bit, key.d);
+        gmp_printf("d (%Zd bits) = %Zd\n", bit, key.d);
 
         mpz_clear(bit);
     }
 
-    // Decryption.
-    rsa_decrypt_file(infile, outfile, n, d);
+    // Decryption. Indexed containers start with a header line, and can
+    // have a range of bytes decrypted without touching the rest. A shard
+    // covers the blocks in one range of a plain encrypted file, for the
+    // merge program to join with the others.
+    uint32_t flags = sharded == true ? 0 : rsa_read_header(infile);
+    if (sharded == true) {
+        uint64_t end = len > UINT64_MAX - start ? UINT64_MAX : start + len;
+        if (ranged == true
+            || (shard_count > 0
+                && rsa_shard_bounds(infile, shard_index, shard_count, &start, &end) == false)
+            || rsa_decrypt_shard(infile, outfile, key.n, key.d, start, end) == false) {
+            fprintf(stderr, "Unable to decrypt the shard; shards need an intact, seekable "
+                            "file written without -x or -z.\n");
+            return 1;
+        }
+    } else if (ranged == true) {
+        if ((flags & RSA_FLAG_INDEX) == 0 || (flags & RSA_FLAG_LZ) != 0
+            || rsa_decrypt_range(infile, outfile, key.n, key.d, start, len) == false) {
+            fprintf(stderr, "Unable to decrypt the range; ranges need a seekable file "
+                            "written by encrypt -x.\n");
+            return 1;
+        }
+    } else if ((flags & RSA_FLAG_LZ) != 0) {
+        FILE *packed = tmpfile();
+        if (packed == NULL) {
+            perror("Failed");
+            return 1;
+        }
+        rsa_decrypt_file(infile, packed, key.n, key.d);
+        rewind(packed);
+        if (lz_decompress_file(packed, outfile) == false) {
+            fprintf(stderr, "Compressed data is corrupt.\n");
+            return 1;
+        }
+        fclose(packed);
+    } else {
+        rsa_decrypt_file(infile, outfile, key.n, key.d);
+    }
 
     // Termination.
     fclose(pvfile);
@@ -119,5 +216,5 @@ int main(int argc, char **argv) {
     if (gotoutfile == true) {
         fclose(outfile);
     }
-    mpz_clears(n, d, NULL);
+    key_clear(&key);
 }
@@ -5,9 +5,14 @@
 #include <sys/stat.h>
 #include <gmp.h>
 
+#include "keyfile.h"
+#include "lz.h"
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "store.h"
+#include "tool.h"
+#include "tune.h"
 
 // Helper function for bit calculation.
 void bits_num(mpz_t bit, mpz_t n) {
@@ -23,6 +28,40 @@ void bits_num(mpz_t bit, mpz_t n) {
     mpz_clears(count, temp_n, NULL);
 }
 
+// Helper function to read a recipient's public key, either from a key
+// file or from the key store.
+//
+// Returns true if the key was read, false if it wasn't. Sets verified
+// if the key came from the store and so needs no signature check.
+bool read_recipient(rsa_key *key, char *name, bool from_store, char *storedir, bool *verified) {
+    if (from_store == true) {
+        store_entry entry;
+        if (store_open_key(storedir, name, key, &entry) == false) {
+            fprintf(stderr, "No verified key for %s in %s.\n", name, storedir);
+            return false;
+        }
+        *verified = true;
+        return true;
+    }
+
+    FILE *pbfile = fopen(name, "r");
+    if (pbfile == NULL) {
+        perror("Failed");
+        return false;
+    }
+    bool ok = key_read(key, pbfile);
+    fclose(pbfile);
+    if (ok == false || key->priv == true) {
+        if (ok == true) {
+            key_clear(key);
+        }
+        fprintf(stderr, "Unable to read public key.\n");
+        return false;
+    }
+    *verified = false;
+    return true;
+}
+
 // Main function. Takes input from the command line.
 // Returns 0 upon successful run.
 //
@@ -31,15 +70,26 @@ void bits_num(mpz_t bit, mpz_t n) {
 int main(int argc, char **argv) {
     int opt = 0;
     bool verbose = false;
-    bool gotpubfile = false;
+    bool indexed = false;
+    bool compress = false;
+    bool sharded = false;
+    uint64_t shard_index = 0;
+    uint64_t shard_count = 0;
+    uint64_t start = 0;
+    uint64_t len = 0;
     bool gotinfile = false;
-    bool gotoutfile = false;
-    FILE *pbfile;
+    char *storedir = "rsa.keys";
     FILE *infile;
-    FILE *outfile;
+
+    // Recipients and output files, in the order they were given.
+    uint64_t nkeys = 0;
+    uint64_t nout = 0;
+    char **names = calloc(argc, sizeof(char *));
+    bool *from_store = calloc(argc, sizeof(bool));
+    FILE **outfiles = calloc(argc, sizeof(FILE *));
 
     // Parse command line options.
-    while ((opt = getopt(argc, argv, "hvi:o:n:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvxzi:o:n:k:u:S:R:")) != -1) {
         switch (opt) {
         case 'h':
             printf("SYNOPSIS\n   Encrypts data using RSA encryption.\n   Encrypted data is "
@@ -48,9 +98,36 @@ int main(int argc, char **argv) {
                    "help and usage.\n   -v              Display verbose program output.\n   -i "
                    "infile       Input file of data to encrypt (default: stdin).\n   -o outfile    "
                    "  Output file for encrypted data (default: stdout).\n   -n pbfile       Public "
-                   "key file (default: rsa.pub).\n");
+                   "key file (default: rsa.pub).\n   -x              Write an indexed container that "
+                   "decrypt -r can read\n                   byte ranges from.\n   -z              "
+                   "Compress the input before encrypting it.\n   -u name         Encrypt to a "
+                   "recipient from the key store.\n   -k store        Key store directory "
+                   "(default: rsa.keys).\n   -S i/N          Encrypt only shard i of N of the input, "
+                   "for\n                   the merge program to join.\n   -R start:len    Encrypt "
+                   "only len bytes of the input from offset\n                   start, as a shard "
+                   "for the merge program.\n\n   -n and -u may be repeated to encrypt to several "
+                   "recipients at once,\n   with one -o for each, in the same order.\n");
             return 1;
         case 'v': verbose = true; break;
+        case 'x': indexed = true; break;
+        case 'z': compress = true; break;
+        case 'k': storedir = optarg; break;
+        case 'S':
+            if (sscanf(optarg, "%" SCNu64 "/%" SCNu64, &shard_index, &shard_count) != 2
+                || shard_index >= shard_count) {
+                fprintf(stderr, "Shard must be given as i/N, with i less than N.\n");
+                return 1;
+            }
+            sharded = true;
+            break;
+        case 'R':
+            if (sscanf(optarg, "%" SCNu64 ":%" SCNu64, &start, &len) != 2) {
+                fprintf(stderr, "Range must be given as start:len.\n");
+                return 1;
+            }
+            shard_count = 0;
+            sharded = true;
+            break;
         case 'i':
             infile = fopen(optarg, "r");
             if (infile == NULL) {
@@ -60,75 +137,171 @@ int main(int argc, char **argv) {
             gotinfile = true;
             break;
         case 'o':
-            outfile = fopen(optarg, "w");
-            if (outfile == NULL) {
+            outfiles[nout] = fopen(optarg, "w");
+            if (outfiles[nout] == NULL) {
                 perror("Failed");
                 return 1;
             }
-            gotoutfile = true;
+            nout += 1;
             break;
         case 'n':
-            pbfile = fopen(optarg, "r");
-            if (pbfile == NULL) {
-                perror("Failed");
-                return 1;
-            }
-            gotpubfile = true;
+        case 'u':
+            names[nkeys] = optarg;
+            from_store[nkeys] = opt == 'u';
+            nkeys += 1;
             break;
         }
     }
 
-    // Open the key files if they were not opened in getopt().
-    if (gotpubfile == false) {
-        pbfile = fopen("rsa.pub", "r");
+    // Shared setup: the memory pool and the tuning file.
+    tool_init(false);
+
+    // Ranges index the plaintext that was encrypted, which for a
+    // compressed file is the compressed stream.
+    if (indexed == true && compress == true) {
+        fprintf(stderr, "Indexed containers cannot be compressed.\n");
+        return 1;
+    }
+
+    // Use the default key file and streams if none were given.
+    if (nkeys == 0) {
+        names[0] = "rsa.pub";
+        nkeys = 1;
     }
     if (gotinfile == false) {
         infile = stdin;
     }
-    if (gotoutfile == false) {
-        outfile = stdout;
+    if (nout == 0 && nkeys == 1) {
+        outfiles[0] = stdout;
+    } else if (nout != nkeys) {
+        fprintf(stderr, "Each recipient needs its own output file.\n");
+        return 1;
+    }
+    if (indexed == true && nkeys > 1) {
+        fprintf(stderr, "Indexed containers have a single recipient.\n");
+        return 1;
+    }
+    if (sharded == true && (nkeys > 1 || indexed == true || compress == true)) {
+        fprintf(stderr, "Shards have a single recipient and no container options.\n");
+        return 1;
     }
 
-    mpz_t n, e, s, user;
-    mpz_inits(n, e, s, user, NULL);
-    char user_buf[256];
+    // Read the keys. Binary keys are mapped rather than parsed, and keys
+    // from the store have already had their signature checked.
+    rsa_key *keys = calloc(nkeys, sizeof(rsa_key));
+    mpz_ptr *ns = calloc(nkeys, sizeof(mpz_ptr));
+    mpz_ptr *es = calloc(nkeys, sizeof(mpz_ptr));
+    mpz_t user;
+    mpz_init(user);
 
-    rsa_read_pub(n, e, s, user_buf, pbfile);
+    for (uint64_t i = 0; i < nkeys; i++) {
+        rsa_key *key = &keys[i];
+        bool verified;
+        if (read_recipient(key, names[i], from_store[i], storedir, &verified) == false) {
+            return 1;
+        }
+        ns[i] = key->n;
+        es[i] = key->e;
 
-    // Print stats if verbose.
-    if (verbose == true) {
-        mpz_t bit;
-        mpz_init(bit);
+        // Print stats if verbose.
+        if (verbose == true) {
+            mpz_t bit;
+            mpz_init(bit);
+
+            printf("user = %s\n", key->username);
+            bits_num(bit, key->s);
+            gmp_printf("s (%Zd bits) = %Zd\n", bit, key->s);
+            bits_num(bit, key->n);
+            gmp_printf("n (%Zd bits) = %Zd\n", bit, key->n);
+            bits_num(bit, key->e);
+            gmp_printf("e (%Zd bits) = %Zd\n", bit, key->e);
+
+            mpz_clear(bit);
+        }
 
-        printf("user = %s\n", user_buf);
-        bits_num(bit, s);
-        gmp_printf("s (%Zd bits) = %Zd\n", bit, s);
-        bits_num(bit, n);
-        gmp_printf("n (%Zd bits) = %Zd\n", bit, n);
-        bits_num(bit, e);
-        gmp_printf("e (%Zd bits) = %Zd\n", bit, e);
+        mpz_set_str(user, key->username, 62);
 
-        mpz_clear(bit);
+        // Signature verification.
+        if (verified == false && rsa_verify(user, key->s, key->e, key->n) == false) {
+            printf("Signature unable to be verified.\n");
+            return 1;
+        }
     }
 
-    mpz_set_str(user, user_buf, 62);
+    // Apply the tuned settings for the largest key. Nothing has been read
+    // from the input or written to the outputs yet, so their buffers can
+    // be resized; stdout may already hold verbose output.
+    uint64_t nbits = 0;
+    for (uint64_t i = 0; i < nkeys; i++) {
+        nbits = keys[i].nbits > nbits ? keys[i].nbits : nbits;
+    }
+    tune_entry tune = tune_apply(nbits);
+    tune_buffer(infile, &tune);
+    for (uint64_t i = 0; i < nkeys; i++) {
+        if (outfiles[i] != stdout) {
+            tune_buffer(outfiles[i], &tune);
+        }
+    }
+    uint64_t bufsize = tune.bufsize != 0 ? tune.bufsize : RSA_BUFFER_SIZE;
 
-    // Signature verification.
-    if (rsa_verify(user, s, e, n) == false) {
-        printf("Signature unable to be verified.\n");
-        return 1;
+    // Compression happens once, however many recipients there are.
+    // Fewer plaintext bytes means fewer blocks to exponentiate.
+    FILE *source = infile;
+    if (compress == true) {
+        source = tmpfile();
+        if (source == NULL || lz_compress_file(infile, source) == false) {
+            fprintf(stderr, "Unable to compress input.\n");
+            return 1;
+        }
+        rewind(source);
+        for (uint64_t i = 0; i < nkeys; i++) {
+            rsa_write_header(outfiles[i], RSA_FLAG_LZ);
+        }
     }
 
-    // Encryption.
-    rsa_encrypt_file(infile, outfile, n, e);
+    // Encryption. A shard covers one range of the input, and is
+    // written with a header saying which, so shards from many processes
+    // can be merged back into the file a single run would write.
+    if (sharded == true) {
+        uint64_t end = len > UINT64_MAX - start ? UINT64_MAX : start + len;
+        if ((shard_count > 0
+                && rsa_shard_bounds(source, shard_index, shard_count, &start, &end) == false)
+            || rsa_encrypt_shard(source, outfiles[0], ns[0], es[0], start, end) == false) {
+            fprintf(stderr, "Unable to encrypt the shard; shards need a seekable input file.\n");
+            return 1;
+        }
+    } else if (indexed == true) {
+        if (rsa_encrypt_file_indexed(source, outfiles[0], ns[0], es[0]) == false) {
+            fprintf(stderr, "Unable to write the indexed container.\n");
+            return 1;
+        }
+    } else if (nkeys > 1) {
+        if (rsa_encrypt_file_multi(source, outfiles, ns, es, nkeys, bufsize) == false) {
+            fprintf(stderr, "Unable to encrypt for every recipient.\n");
+            return 1;
+        }
+    } else {
+        rsa_encrypt_file(source, outfiles[0], ns[0], es[0]);
+    }
 
     // Termination.
-    fclose(pbfile);
+    if (source != infile) {
+        fclose(source);
+    }
     if (gotinfile == true) {
         fclose(infile);
     }
-    if (gotoutfile == true) {
-        fclose(outfile);
+    for (uint64_t i = 0; i < nout; i++) {
+        fclose(outfiles[i]);
+    }
+    for (uint64_t i = 0; i < nkeys; i++) {
+        key_clear(&keys[i]);
     }
-    mpz_clears(n, e, s, user, NULL);
+    mpz_clear(user);
+    free(keys);
+    free(ns);
+    free(es);
+    free(names);
+    free(from_store);
+    free(outfiles);
 }
@@ -0,0 +1,66 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "jobs.h"
+
+// Function to find job i of an array of jobs each size bytes long. A
+// size of 0 means every job shares the same argument.
+static void *jobs_at(uint8_t *jobs, uint64_t i, size_t size) {
+    return &jobs[i * size];
+}
+
+// Function to start count jobs on their own threads, running fn on each
+// job in the array jobs of size byte elements, or on jobs itself for all
+// of them if size is 0. Jobs that can't be started are run by
+// jobs_finish instead, so every job runs once either way.
+//
+// Returns true if every job was started, false otherwise.
+bool jobs_start(job_group *group, job_fn fn, void *jobs, uint64_t count, size_t size) {
+    *group = (job_group) { fn, jobs, size, count, 0, NULL };
+    if (count == 0) {
+        return true;
+    }
+    group->threads = calloc(count, sizeof(pthread_t));
+    for (uint64_t t = 0; group->threads != NULL && t < count; t++) {
+        if (pthread_create(&group->threads[t], NULL, fn, jobs_at(group->jobs, t, size)) != 0) {
+            break;
+        }
+        group->started += 1;
+    }
+    return group->started == count;
+}
+
+// Function to wait for the jobs started by jobs_start, then run any
+// that couldn't be started on this thread.
+void jobs_finish(job_group *group) {
+    for (uint64_t t = 0; t < group->started; t++) {
+        pthread_join(group->threads[t], NULL);
+    }
+    for (uint64_t t = group->started; t < group->count; t++) {
+        group->fn(jobs_at(group->jobs, t, group->size));
+    }
+    free(group->threads);
+    group->threads = NULL;
+}
+
+// Function to run fn on count jobs in parallel and wait for them all,
+// as jobs_start and jobs_finish do. The first job runs on this thread
+// and the rest on workers.
+void run_jobs(job_fn fn, void *jobs, uint64_t count, size_t size) {
+    if (count == 0) {
+        return;
+    }
+    job_group group;
+    jobs_start(&group, fn, jobs_at(jobs, 1, size), count - 1, size);
+    fn(jobs);
+    jobs_finish(&group);
+}
+
+// Function to read a monotonic clock, for timing work.
+//
+// Returns the seconds since some fixed point.
+double clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
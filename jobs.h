@@ -0,0 +1,27 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A function run as a job, with the pthread_create() signature.
+typedef void *(*job_fn)(void *arg);
+
+// Jobs running on worker threads, from jobs_start until jobs_finish.
+typedef struct {
+    job_fn fn;
+    uint8_t *jobs;
+    size_t size;
+    uint64_t count;
+    uint64_t started;
+    pthread_t *threads;
+} job_group;
+
+bool jobs_start(job_group *group, job_fn fn, void *jobs, uint64_t count, size_t size);
+
+void jobs_finish(job_group *group);
+
+void run_jobs(job_fn fn, void *jobs, uint64_t count, size_t size);
+
+double clock_now(void);
@@ -0,0 +1,172 @@
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "keyfile.h"
+#include "rsa.h"
+
+#define KEY_MAGIC   "RSAKEYB\0"
+#define KEY_VERSION 2
+#define KEY_ORDER   0x01020304
+
+// On-disk header of a binary key. The limbs of n, e, s and d follow it,
+// each at the byte offset recorded in off[] and len[] limbs long, in
+// the native limb size and byte order of the machine that wrote it.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t priv;
+    uint32_t limb_size;
+    uint32_t order;
+    uint64_t nbits;
+    uint64_t off[4];
+    uint64_t len[4];
+    char username[KEY_USER_MAX];
+} key_header;
+
+// Function to initialize an empty key so its values can be set
+// directly, as keygen does.
+void key_init(rsa_key *key, bool priv) {
+    memset(key, 0, sizeof(rsa_key));
+    key->priv = priv;
+    mpz_inits(key->n, key->e, key->s, key->d, NULL);
+}
+
+// Function to fill in the values derived from n.
+void key_derive(rsa_key *key) {
+    key->nbits = mpz_sizeinbase(key->n, 2);
+}
+
+// Function to point the values of key at the limbs of a mapped
+// binary key file, checking that every field lies inside the mapping
+// and that the recorded bit length is that of n.
+//
+// Returns true if the mapping holds a valid key, false if it doesn't.
+static bool key_from_map(rsa_key *key, uint8_t *map, size_t map_len) {
+    key_header *hdr = (key_header *) map;
+    mpz_ptr vals[4] = { key->n, key->e, key->s, key->d };
+
+    if (map_len < sizeof(key_header) || hdr->version != KEY_VERSION
+        || hdr->limb_size != sizeof(mp_limb_t) || hdr->order != KEY_ORDER) {
+        return false;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t off = hdr->off[i];
+        uint64_t len = hdr->len[i];
+        if (off % sizeof(mp_limb_t) != 0 || off > map_len
+            || len > (map_len - off) / sizeof(mp_limb_t)) {
+            return false;
+        }
+        mp_limb_t *limbs = (mp_limb_t *) (map + off);
+        if (len > 0 && limbs[len - 1] == 0) {
+            return false;
+        }
+        mpz_roinit_n(vals[i], limbs, len);
+    }
+
+    if (hdr->nbits != mpz_sizeinbase(key->n, 2)) {
+        return false;
+    }
+
+    key->priv = hdr->priv != 0;
+    key->nbits = hdr->nbits;
+    memcpy(key->username, hdr->username, KEY_USER_MAX);
+    key->username[KEY_USER_MAX - 1] = '\0';
+    key->map = map;
+    key->map_len = map_len;
+    return true;
+}
+
+// Function to read a key from keyfile. Binary keys are mapped and used
+// in place; text keys are parsed, and are public if they hold a
+// username and private if they only hold n and d.
+//
+// Returns true if a key was read, false if it wasn't.
+bool key_read(rsa_key *key, FILE *keyfile) {
+    char magic[8];
+    memset(key, 0, sizeof(rsa_key));
+
+    if (fread(magic, 1, sizeof(magic), keyfile) == sizeof(magic)
+        && memcmp(magic, KEY_MAGIC, sizeof(magic)) == 0) {
+        struct stat st;
+        int fd = fileno(keyfile);
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(key_header)) {
+            return false;
+        }
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        if (key_from_map(key, map, st.st_size) == false) {
+            munmap(map, st.st_size);
+            return false;
+        }
+        return true;
+    }
+
+    // Text format: n, e, s and the username, or just n and d.
+    rewind(keyfile);
+    key_init(key, false);
+    int got = gmp_fscanf(keyfile, "%Zx\n%Zx\n%Zx\n%255s\n", key->n, key->e, key->s, key->username);
+    if (got == 2) {
+        key->priv = true;
+        mpz_swap(key->d, key->e);
+    } else if (got != 4) {
+        key_clear(key);
+        return false;
+    }
+    key_derive(key);
+    return true;
+}
+
+// Function to write a key in the text format used by
+// rsa_write_pub and rsa_write_priv.
+void key_write_text(rsa_key *key, FILE *keyfile) {
+    if (key->priv == true) {
+        rsa_write_priv(key->n, key->d, keyfile);
+    } else {
+        rsa_write_pub(key->n, key->e, key->s, key->username, keyfile);
+    }
+}
+
+// Function to write a key in the binary format read by key_read.
+//
+// Returns true if the key was written, false if writing failed.
+bool key_write_bin(rsa_key *key, FILE *keyfile) {
+    mpz_ptr vals[4] = { key->n, key->e, key->s, key->d };
+    key_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+
+    memcpy(hdr.magic, KEY_MAGIC, sizeof(hdr.magic));
+    hdr.version = KEY_VERSION;
+    hdr.priv = key->priv == true ? 1 : 0;
+    hdr.limb_size = sizeof(mp_limb_t);
+    hdr.order = KEY_ORDER;
+    hdr.nbits = key->nbits;
+    strncpy(hdr.username, key->username, KEY_USER_MAX - 1);
+
+    uint64_t off = sizeof(key_header);
+    for (int i = 0; i < 4; i++) {
+        hdr.off[i] = off;
+        hdr.len[i] = mpz_size(vals[i]);
+        off += hdr.len[i] * sizeof(mp_limb_t);
+    }
+
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, keyfile) == 1;
+    for (int i = 0; i < 4 && ok == true; i++) {
+        ok = fwrite(mpz_limbs_read(vals[i]), sizeof(mp_limb_t), hdr.len[i], keyfile) == hdr.len[i];
+    }
+    return ok;
+}
+
+// Function to release a key. Mapped keys are unmapped; parsed keys
+// have their values cleared.
+void key_clear(rsa_key *key) {
+    if (key->map != NULL) {
+        munmap(key->map, key->map_len);
+    } else {
+        mpz_clears(key->n, key->e, key->s, key->d, NULL);
+    }
+    memset(key, 0, sizeof(rsa_key));
+}
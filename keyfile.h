@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <gmp.h>
+
+#define KEY_USER_MAX 256
+
+// A public or private key, read from either the text format written by
+// rsa_write_pub/rsa_write_priv or the binary format written by
+// key_write_bin. Binary keys are mapped, and n, e, s and d point
+// straight at the limbs in the mapping, so they must not be modified.
+typedef struct {
+    bool priv;
+    uint64_t nbits; // Bits in n.
+    mpz_t n, e, s, d;
+    char username[KEY_USER_MAX];
+    void *map;
+    size_t map_len;
+} rsa_key;
+
+void key_init(rsa_key *key, bool priv);
+
+void key_derive(rsa_key *key);
+
+bool key_read(rsa_key *key, FILE *keyfile);
+
+void key_write_text(rsa_key *key, FILE *keyfile);
+
+bool key_write_bin(rsa_key *key, FILE *keyfile);
+
+void key_clear(rsa_key *key);
@@ -1,13 +1,23 @@
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <sys/stat.h>
 #include <gmp.h>
 
+#include "jobs.h"
+#include "keyfile.h"
 #include "numtheory.h"
+#include "pool.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "sha256.h"
+#include "store.h"
+#include "tool.h"
+#include "tune.h"
 
 // Helper function for bit calculation.
 // Takes in two mpz_t's, and sets the
@@ -29,6 +39,233 @@ void bits_num(mpz_t bit, mpz_t n) {
     mpz_clears(count, temp_n, NULL);
 }
 
+// Helper function to convert a key between the text and binary
+// formats. Text keys are written as binary and binary keys as text.
+//
+// Returns 0 on success, 1 if the key couldn't be read or written.
+int convert_key(FILE *infile, FILE *outfile) {
+    rsa_key key;
+    if (key_read(&key, infile) == false) {
+        fprintf(stderr, "Unable to read key.\n");
+        return 1;
+    }
+
+    if (key.priv == true) {
+        fchmod(fileno(outfile), S_IRUSR | S_IWUSR);
+    }
+
+    bool ok = true;
+    if (key.map != NULL) {
+        key_write_text(&key, outfile);
+    } else {
+        ok = key_write_bin(&key, outfile);
+    }
+    key_clear(&key);
+
+    if (ok == false) {
+        fprintf(stderr, "Unable to write key.\n");
+        return 1;
+    }
+    return 0;
+}
+
+// Helper function to fill in a generated key pair.
+void build_keys(
+    rsa_key *pub, rsa_key *priv, mpz_t n, mpz_t e, mpz_t s, mpz_t d, char username[]) {
+    key_init(pub, false);
+    key_init(priv, true);
+
+    mpz_set(pub->n, n);
+    mpz_set(pub->e, e);
+    mpz_set(pub->s, s);
+    strncpy(pub->username, username, KEY_USER_MAX - 1);
+    key_derive(pub);
+
+    mpz_set(priv->n, n);
+    mpz_set(priv->d, d);
+    key_derive(priv);
+}
+
+// Helper function to write a generated key pair in the binary format.
+void write_bin_keys(mpz_t n, mpz_t e, mpz_t s, mpz_t d, char username[], FILE *pbfile,
+    FILE *pvfile) {
+    rsa_key pub, priv;
+    build_keys(&pub, &priv, n, e, s, d, username);
+
+    key_write_bin(&pub, pbfile);
+    key_write_bin(&priv, pvfile);
+
+    key_clear(&pub);
+    key_clear(&priv);
+}
+
+// Number of generated keys held back and added to the index at once.
+#define BATCH_APPEND 256
+
+// State shared by the threads of a batch of key generations. The
+// fingerprints of the keys already in the store, and those generated so
+// far, are kept in known, so a rerun with the same seed doesn't index a
+// key twice.
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t next;
+    uint64_t done;
+    uint64_t count;
+    uint64_t nbits;
+    uint64_t iters;
+    uint8_t seed[SHA256_DIGEST_SIZE];
+    char *prefix;
+    char *dir;
+    bool failed;
+    store_fp_set known;
+    store_entry *pending; // New entries not yet in the index.
+    uint64_t npending;
+} batch;
+
+// Helper function to generate key number i of a batch into the key
+// store. Each key has its own random state, seeded with the hash of the
+// batch seed and i, so no two keys share a stream of random numbers and
+// a batch can be reproduced from its seed.
+//
+// Returns true if the key was generated and stored, or was already in
+// the store, false otherwise.
+bool batch_key(batch *b, uint64_t i) {
+    uint8_t material[SHA256_DIGEST_SIZE + 8], seed[SHA256_DIGEST_SIZE];
+    memcpy(material, b->seed, SHA256_DIGEST_SIZE);
+    for (int j = 0; j < 8; j++) {
+        material[SHA256_DIGEST_SIZE + j] = (uint8_t) (i >> (56 - 8 * j));
+    }
+    sha256(seed, material, sizeof(material));
+    randstate_init_bytes(seed, sizeof(seed));
+
+    mpz_t p, q, n, e, d, user, sig;
+    mpz_inits(p, q, n, e, d, user, sig, NULL);
+    rsa_make_pub(p, q, n, e, b->nbits, b->iters);
+    rsa_make_priv(d, e, p, q);
+
+    store_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    snprintf(entry.username, KEY_USER_MAX, "%s%" PRIu64, b->prefix, i);
+    mpz_set_str(user, entry.username, 62);
+    rsa_sign(sig, user, d, n);
+
+    rsa_key pub, priv;
+    build_keys(&pub, &priv, n, e, sig, d, entry.username);
+    store_fingerprint(entry.fingerprint, &pub);
+    entry.verified = true;
+
+    pthread_mutex_lock(&b->lock);
+    bool fresh = store_fp_set_add(&b->known, entry.fingerprint);
+    pthread_mutex_unlock(&b->lock);
+
+    // New entries are added to the index a block at a time, so that
+    // workers rarely wait on the store's lock.
+    bool ok = fresh == false
+              || (store_write_key(b->dir, &pub, entry.fingerprint)
+                  && store_write_key(b->dir, &priv, entry.fingerprint));
+    if (fresh == true && ok == true) {
+        pthread_mutex_lock(&b->lock);
+        b->pending[b->npending++] = entry;
+        if (b->npending == BATCH_APPEND) {
+            ok = store_append(b->dir, b->pending, b->npending);
+            b->npending = 0;
+        }
+        pthread_mutex_unlock(&b->lock);
+    }
+
+    key_clear(&pub);
+    key_clear(&priv);
+    mpz_clears(p, q, n, e, d, user, sig, NULL);
+    randstate_clear();
+    return ok;
+}
+
+// Worker thread which takes keys from the batch until none are left.
+void *batch_worker(void *arg) {
+    batch *b = arg;
+    while (true) {
+        pthread_mutex_lock(&b->lock);
+        uint64_t i = b->next;
+        bool stop = i >= b->count || b->failed == true;
+        b->next += 1;
+        pthread_mutex_unlock(&b->lock);
+        if (stop == true) {
+            break;
+        }
+
+        bool ok = batch_key(b, i);
+
+        pthread_mutex_lock(&b->lock);
+        b->done += 1;
+        b->failed = b->failed == true || ok == false;
+        pthread_mutex_unlock(&b->lock);
+    }
+    pool_thread_release();
+    return NULL;
+}
+
+// Helper function to generate count key pairs into the key store at dir
+// on nthreads threads, reporting progress and throughput to stderr once
+// a second.
+//
+// Returns 0 on success, 1 if any key couldn't be generated or stored.
+int batch_keygen(batch *b, uint64_t nthreads) {
+    b->pending = calloc(BATCH_APPEND, sizeof(store_entry));
+    if (b->pending == NULL || store_fp_set_load(&b->known, b->dir, b->count) == false) {
+        perror("Failed");
+        free(b->pending);
+        return 1;
+    }
+
+    job_group workers;
+    pthread_mutex_init(&b->lock, NULL);
+
+    // Every worker shares the batch. Any that can't be started are run
+    // on this thread by jobs_finish, which does the whole batch there if
+    // no worker could be started.
+    double start = clock_now();
+    jobs_start(&workers, batch_worker, b, nthreads, 0);
+
+    double last = start;
+    uint64_t done = 0;
+    while (done < b->count && workers.started > 0) {
+        struct timespec tick = { 0, 100000000 };
+        nanosleep(&tick, NULL);
+
+        pthread_mutex_lock(&b->lock);
+        done = b->done;
+        bool failed = b->failed;
+        pthread_mutex_unlock(&b->lock);
+        if (failed == true) {
+            break;
+        }
+
+        double t = clock_now();
+        if (t - last >= 1.0) {
+            fprintf(stderr, "generated %" PRIu64 "/%" PRIu64 " keys (%.1f keys/s)\n", done,
+                b->count, done / (t - start));
+            last = t;
+        }
+    }
+    jobs_finish(&workers);
+    if (b->npending > 0 && store_append(b->dir, b->pending, b->npending) == false) {
+        b->failed = true;
+    }
+
+    double elapsed = clock_now() - start;
+    fprintf(stderr, "generated %" PRIu64 " keys in %.2fs (%.1f keys/s) into %s\n", b->done,
+        elapsed, b->done / (elapsed > 0 ? elapsed : 1), b->dir);
+
+    pthread_mutex_destroy(&b->lock);
+    store_fp_set_clear(&b->known);
+    free(b->pending);
+    if (b->failed == true) {
+        fprintf(stderr, "Unable to store keys in %s.\n", b->dir);
+        return 1;
+    }
+    return 0;
+}
+
 // Main function. Takes input from the command line.
 // Returns 0 upon successful run.
 //
@@ -40,23 +277,40 @@ int main(int argc, char **argv) {
     uint64_t iters = 50;
     uint64_t seed = time(NULL);
     bool verbose = false;
+    bool binary = false;
+    bool lock = false;
+    bool gotseed = false;
+    uint64_t count = 0;
+    uint64_t nthreads = 0;
+    char *storedir = "rsa.keys";
+    char *prefix = getenv("USER");
     bool gotpubfile = false;
     bool gotprvfile = false;
+    bool gotcvfile = false;
+    bool gotoutfile = false;
     FILE *pbfile;
     FILE *pvfile;
+    FILE *cvfile;
+    FILE *outfile;
 
     // Parse command line options.
-    while ((opt = getopt(argc, argv, "hvb:i:n:d:s:")) != -1) {
+    while ((opt = getopt(argc, argv, "hvlBb:i:n:d:s:c:o:N:t:K:p:")) != -1) {
         switch (opt) {
         case 'h':
             printf("SYNOPSIS\n   Generates an RSA public/private key pair.\n\nUSAGE\n   ./keygen "
                    "[-hv] [-b bits] -n pbfile -d pvfile\n\nOPTIONS\n   -h              Display "
                    "program help and usage.\n   -v              Display verbose program output.\n  "
-                   " -b bits         Minimum bits needed for public key n.\n   -c confidence   "
+                   " -b bits         Minimum bits needed for public key n.\n   -i iters        "
                    "Miller-Rabin iterations for testing primes (default: 50).\n   -n pbfile       "
                    "Public key file (default: rsa.pub).\n   -d pvfile       Private key file "
                    "(default: rsa.priv).\n   -s seed         Random seed for "
-                   "testing.\nknoxa@ubuntu:~/resources/asgn6$ \n");
+                   "testing.\n   -B              Write the keys in the binary format.\n   -c "
+                   "keyfile      Convert a key between the text and binary formats.\n   -o "
+                   "outfile      Output file for a converted key (default: stdout).\n   -N count        "
+                   "Generate count key pairs into the key store.\n   -t threads      Threads for "
+                   "-N (default: tuned, or online CPUs).\n   -K store        Key store directory for -N "
+                   "(default: rsa.keys).\n   -p prefix       Username prefix for -N (default: "
+                   "$USER).\n   -l              Lock key material in memory.\n");
             return 1;
         case 'v': verbose = true; break;
         case 'b': nbits = atoi(optarg); break;
@@ -77,10 +331,95 @@ int main(int argc, char **argv) {
             }
             gotprvfile = true;
             break;
-        case 's': seed = atoi(optarg); break;
+        case 's':
+            seed = atoi(optarg);
+            gotseed = true;
+            break;
+        case 'N': count = strtoull(optarg, NULL, 10); break;
+        case 't': nthreads = strtoull(optarg, NULL, 10); break;
+        case 'K': storedir = optarg; break;
+        case 'p': prefix = optarg; break;
+        case 'B': binary = true; break;
+        case 'l': lock = true; break;
+        case 'c':
+            cvfile = fopen(optarg, "r");
+            if (cvfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotcvfile = true;
+            break;
+        case 'o':
+            outfile = fopen(optarg, "w");
+            if (outfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotoutfile = true;
+            break;
         }
     }
 
+    // Shared setup: the memory pool, locked if requested since it will
+    // hold the private key, and the tuning file.
+    if (tool_init(lock) == false) {
+        return 1;
+    }
+
+    // Convert an existing key instead of generating a new pair.
+    if (gotcvfile == true) {
+        if (gotoutfile == false) {
+            outfile = stdout;
+        }
+        int status = convert_key(cvfile, outfile);
+        fclose(cvfile);
+        if (gotoutfile == true) {
+            fclose(outfile);
+        }
+        return status;
+    }
+
+    // Apply the tuned settings. Key generation exponentiates modulo
+    // candidate primes, which are half the size of n.
+    tune_entry tune = tune_apply(nbits / 2);
+    if (nthreads == 0) {
+        nthreads = tune.threads;
+    }
+
+    // Generate a batch of keys into the key store instead of one pair.
+    if (count > 0) {
+        batch b;
+        memset(&b, 0, sizeof(b));
+        b.count = count;
+        b.nbits = nbits;
+        b.iters = iters;
+        b.prefix = prefix;
+        b.dir = storedir;
+
+        // Usernames are signed as base 62 numbers.
+        if (prefix == NULL || strspn(prefix, "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                              "abcdefghijklmnopqrstuvwxyz")
+                                  != strlen(prefix)) {
+            fprintf(stderr, "Username prefix must be letters and digits.\n");
+            return 1;
+        }
+
+        // Without a seed, seed the batch from the system so batches started
+        // in the same second still differ.
+        FILE *urandom = gotseed == true ? NULL : fopen("/dev/urandom", "r");
+        if (urandom == NULL || fread(b.seed, 1, sizeof(b.seed), urandom) != sizeof(b.seed)) {
+            uint8_t raw[8];
+            for (int j = 0; j < 8; j++) {
+                raw[j] = (uint8_t) (seed >> (56 - 8 * j));
+            }
+            sha256(b.seed, raw, sizeof(raw));
+        }
+        if (urandom != NULL) {
+            fclose(urandom);
+        }
+        return batch_keygen(&b, nthreads > 0 ? nthreads : 1);
+    }
+
     // Open the key files if they were not opened in getopt().
     if (gotpubfile == false) {
         pbfile = fopen("rsa.pub", "w");
@@ -120,8 +459,12 @@ int main(int argc, char **argv) {
 
     // Write the keys to their files, along with verbosity
     // (to terminal) if requested.
-    rsa_write_pub(b, e, sig, user_buf, pbfile);
-    rsa_write_priv(b, d, pvfile);
+    if (binary == true) {
+        write_bin_keys(b, e, sig, d, user_buf, pbfile, pvfile);
+    } else {
+        rsa_write_pub(b, e, sig, user_buf, pbfile);
+        rsa_write_priv(b, d, pvfile);
+    }
     if (verbose == true) {
         mpz_t bit;
         mpz_init(bit);
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "store.h"
+#include "tool.h"
+
+// Main function. Takes input from the command line.
+// Returns 0 upon successful run.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    int status = 0;
+    bool verbose = false;
+    bool list = false;
+    char *dir = "rsa.keys";
+
+    // Keys to add and remove, as -a or -r and the key named.
+    int nactions = 0;
+    int *ops = calloc(argc, sizeof(int));
+    char **names = calloc(argc, sizeof(char *));
+
+    // Shared setup: the memory pool and the tuning file.
+    tool_init(false);
+
+    // Parse command line options. Adds and removals are only collected
+    // here, so -k applies to them wherever it is given.
+    while ((opt = getopt(argc, argv, "hvlk:a:r:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Manages a store of verified public keys for encrypt.\n\nUSAGE\n"
+                   "   ./keystore [-hvl] [-k store] [-a pbfile] [-r name]\n\nOPTIONS\n   -h     "
+                   "         Display program help and usage.\n   -v              Display verbose "
+                   "program output.\n   -l              List the keys in the store.\n   -k store  "
+                   "      Key store directory (default: rsa.keys).\n   -a pbfile       Verify a "
+                   "public key and add it to the store.\n   -r name         Remove the keys with "
+                   "this username or fingerprint.\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'l': list = true; break;
+        case 'k': dir = optarg; break;
+        case 'a':
+        case 'r':
+            ops[nactions] = opt;
+            names[nactions++] = optarg;
+            break;
+        }
+    }
+
+    // Keys are added and removed in the order they were given.
+    for (int i = 0; i < nactions; i++) {
+        store_entry entry;
+        if (ops[i] == 'r') {
+            if (store_remove(dir, names[i]) == false) {
+                fprintf(stderr, "No key named %s in %s.\n", names[i], dir);
+                status = 1;
+            }
+        } else if (store_add(dir, names[i], &entry) == false) {
+            fprintf(stderr, "Unable to add %s.\n", names[i]);
+            status = 1;
+        } else if (entry.verified == false) {
+            fprintf(stderr, "Signature of %s unable to be verified.\n", names[i]);
+            status = 1;
+        } else if (verbose == true) {
+            printf("added %s %s\n", entry.username, entry.fingerprint);
+        }
+    }
+    free(ops);
+    free(names);
+
+    if (list == true && store_list(dir, stdout) == false) {
+        perror("Failed");
+        return 1;
+    }
+    return status;
+}
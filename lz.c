@@ -0,0 +1,245 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_STORED    0x80000000u
+
+// Function to hash the four bytes at p into the match table.
+static uint32_t lz_hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Function to write a length that didn't fit in its token nibble as a
+// run of 255's followed by the remainder.
+//
+// Returns the new output position, or cap + 1 if it ran out of room.
+static size_t lz_put_length(uint8_t *dst, size_t op, size_t cap, size_t len) {
+    while (len >= 255) {
+        if (op >= cap) {
+            return cap + 1;
+        }
+        dst[op++] = 255;
+        len -= 255;
+    }
+    if (op >= cap) {
+        return cap + 1;
+    }
+    dst[op++] = (uint8_t) len;
+    return op;
+}
+
+// Function to write one sequence: a token, the literals before the
+// match, and the match offset and length. A match length of 0 marks
+// the final sequence, which only carries literals.
+//
+// Returns the new output position, or cap + 1 if it ran out of room.
+static size_t lz_put_sequence(uint8_t *dst, size_t op, size_t cap, const uint8_t *lit,
+    size_t nlit, size_t offset, size_t mlen) {
+    size_t mcode = mlen > 0 ? mlen - LZ_MIN_MATCH : 0;
+    if (op >= cap) {
+        return cap + 1;
+    }
+    dst[op++] = (uint8_t) ((nlit < 15 ? nlit : 15) << 4 | (mcode < 15 ? mcode : 15));
+    if (nlit >= 15) {
+        op = lz_put_length(dst, op, cap, nlit - 15);
+    }
+    if (op > cap || nlit > cap - op) {
+        return cap + 1;
+    }
+    memcpy(&dst[op], lit, nlit);
+    op += nlit;
+
+    if (mlen == 0) {
+        return op;
+    }
+    if (cap - op < 2) {
+        return cap + 1;
+    }
+    dst[op++] = (uint8_t) offset;
+    dst[op++] = (uint8_t) (offset >> 8);
+    if (mcode >= 15) {
+        op = lz_put_length(dst, op, cap, mcode - 15);
+    }
+    return op;
+}
+
+// Function to compress len bytes of src into dst, which holds cap
+// bytes. Matches are found through a single entry hash table of recent
+// four byte sequences, which keeps compression far cheaper than the
+// modular exponentiations it saves.
+//
+// Returns the compressed length, or 0 if it wouldn't fit in cap.
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    uint32_t *table = calloc(1 << LZ_HASH_BITS, sizeof(uint32_t));
+    if (table == NULL) {
+        return 0;
+    }
+
+    size_t ip = 0, anchor = 0, op = 0;
+    while (ip + LZ_MIN_MATCH <= len && op <= cap) {
+        uint32_t h = lz_hash(&src[ip]);
+        size_t cand = table[h];
+        table[h] = ip + 1;
+
+        if (cand == 0 || ip - (cand - 1) > 0xFFFF || memcmp(&src[cand - 1], &src[ip], 4) != 0) {
+            ip += 1;
+            continue;
+        }
+        cand -= 1;
+
+        size_t mlen = LZ_MIN_MATCH;
+        while (ip + mlen < len && src[cand + mlen] == src[ip + mlen]) {
+            mlen += 1;
+        }
+        op = lz_put_sequence(dst, op, cap, &src[anchor], ip - anchor, ip - cand, mlen);
+        ip += mlen;
+        anchor = ip;
+    }
+    if (op <= cap) {
+        op = lz_put_sequence(dst, op, cap, &src[anchor], len - anchor, 0, 0);
+    }
+
+    free(table);
+    return op <= cap ? op : 0;
+}
+
+// Function to read a length continued past its token nibble.
+//
+// Returns false if the input ran out first.
+static bool lz_get_length(const uint8_t *src, size_t len, size_t *ip, size_t *out) {
+    uint8_t b;
+    do {
+        if (*ip >= len) {
+            return false;
+        }
+        b = src[(*ip)++];
+        *out += b;
+    } while (b == 255);
+    return true;
+}
+
+// Function to decompress len bytes of src into dst, which holds cap
+// bytes. Every length and offset is checked against the buffers, so
+// corrupt input fails rather than reading or writing out of bounds.
+//
+// Returns the decompressed length, or 0 if the input was corrupt.
+size_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    size_t ip = 0, op = 0;
+    while (ip < len) {
+        uint8_t token = src[ip++];
+
+        size_t nlit = token >> 4;
+        if (nlit == 15 && lz_get_length(src, len, &ip, &nlit) == false) {
+            return 0;
+        }
+        if (nlit > len - ip || nlit > cap - op) {
+            return 0;
+        }
+        memcpy(&dst[op], &src[ip], nlit);
+        ip += nlit;
+        op += nlit;
+
+        // The final sequence has no match.
+        if (ip == len) {
+            break;
+        }
+
+        if (len - ip < 2) {
+            return 0;
+        }
+        size_t offset = src[ip] | (size_t) src[ip + 1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && lz_get_length(src, len, &ip, &mlen) == false) {
+            return 0;
+        }
+        mlen += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || mlen > cap - op) {
+            return 0;
+        }
+
+        // Matches may overlap their own output, so copy byte by byte.
+        for (size_t i = 0; i < mlen; i++, op++) {
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op;
+}
+
+// Function to write a frame header: the raw length, and the stored
+// length with its top bit set if the frame was left uncompressed.
+static bool lz_put_frame_header(FILE *outfile, uint32_t raw, uint32_t stored) {
+    uint8_t hdr[8];
+    for (int i = 0; i < 4; i++) {
+        hdr[i] = (uint8_t) (raw >> (24 - 8 * i));
+        hdr[4 + i] = (uint8_t) (stored >> (24 - 8 * i));
+    }
+    return fwrite(hdr, 1, sizeof(hdr), outfile) == sizeof(hdr);
+}
+
+// Function to compress infile into outfile as a sequence of frames.
+// Frames that don't shrink are stored as they are.
+//
+// Returns true on success, false if reading or writing failed.
+bool lz_compress_file(FILE *infile, FILE *outfile) {
+    uint8_t *raw = malloc(LZ_FRAME_SIZE);
+    uint8_t *comp = malloc(LZ_FRAME_SIZE);
+    bool ok = raw != NULL && comp != NULL;
+
+    size_t nbytes;
+    while (ok == true && (nbytes = fread(raw, 1, LZ_FRAME_SIZE, infile)) != 0) {
+        size_t clen = lz_compress(raw, nbytes, comp, nbytes - 1);
+        if (clen != 0) {
+            ok = lz_put_frame_header(outfile, nbytes, clen)
+                 && fwrite(comp, 1, clen, outfile) == clen;
+        } else {
+            ok = lz_put_frame_header(outfile, nbytes, nbytes | LZ_STORED)
+                 && fwrite(raw, 1, nbytes, outfile) == nbytes;
+        }
+    }
+
+    free(raw);
+    free(comp);
+    return ok == true && ferror(infile) == 0;
+}
+
+// Function to decompress a sequence of frames written by
+// lz_compress_file from infile into outfile.
+//
+// Returns true on success, false if the input was corrupt or truncated.
+bool lz_decompress_file(FILE *infile, FILE *outfile) {
+    uint8_t *raw = malloc(LZ_FRAME_SIZE);
+    uint8_t *comp = malloc(LZ_FRAME_SIZE);
+    bool ok = raw != NULL && comp != NULL;
+
+    uint8_t hdr[8];
+    size_t got;
+    while (ok == true && (got = fread(hdr, 1, sizeof(hdr), infile)) != 0) {
+        uint32_t rlen = 0, clen = 0;
+        for (int i = 0; i < 4; i++) {
+            rlen = rlen << 8 | hdr[i];
+            clen = clen << 8 | hdr[4 + i];
+        }
+        bool stored = (clen & LZ_STORED) != 0;
+        clen &= ~LZ_STORED;
+
+        if (got != sizeof(hdr) || rlen > LZ_FRAME_SIZE || clen > LZ_FRAME_SIZE
+            || fread(comp, 1, clen, infile) != clen) {
+            ok = false;
+        } else if (stored == true) {
+            ok = clen == rlen && fwrite(comp, 1, clen, outfile) == clen;
+        } else {
+            ok = lz_decompress(comp, clen, raw, rlen) == rlen
+                 && fwrite(raw, 1, rlen, outfile) == rlen;
+        }
+    }
+
+    free(raw);
+    free(comp);
+    return ok;
+}
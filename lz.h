@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Input is compressed in independent frames of this many bytes, so
+// match offsets always fit in 16 bits.
+#define LZ_FRAME_SIZE (1 << 16)
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+size_t lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap);
+
+bool lz_compress_file(FILE *infile, FILE *outfile);
+
+bool lz_decompress_file(FILE *infile, FILE *outfile);
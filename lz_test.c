@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+
+static int failures = 0;
+static uint64_t rng = 0x9E3779B97F4A7C15u;
+
+// Function to step a small xorshift generator, so the test inputs are
+// the same on every run.
+//
+// Returns the next pseudorandom value.
+uint64_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+// Helper function to fill len bytes of buf with one of the test
+// patterns: 0 is all zeros, 1 is random, 2 is text with many repeats,
+// and 3 mixes random runs with copies of earlier bytes.
+void fill(uint8_t *buf, size_t len, int pattern) {
+    static const char *words[] = { "modulus ", "prime ", "block ", "key ", "the ", "\n" };
+    for (size_t i = 0; i < len;) {
+        switch (pattern) {
+        case 0: buf[i++] = 0; break;
+        case 1: buf[i++] = (uint8_t) next_random(); break;
+        case 2: {
+            const char *w = words[next_random() % 6];
+            for (size_t j = 0; w[j] != '\0' && i < len; j++) {
+                buf[i++] = (uint8_t) w[j];
+            }
+            break;
+        }
+        default: {
+            size_t run = next_random() % 300 + 1;
+            bool copy = i > 0 && next_random() % 2 == 0;
+            size_t from = copy == true ? next_random() % i : 0;
+            for (size_t j = 0; j < run && i < len; j++, i++) {
+                buf[i] = copy == true ? buf[from + j] : (uint8_t) next_random();
+            }
+            break;
+        }
+        }
+    }
+}
+
+// Helper function to compress and decompress len bytes of one pattern
+// in memory, checking the result matches. The output buffer has room
+// for even incompressible input.
+void check_buffer(size_t len, int pattern) {
+    uint8_t *src = malloc(len + 1), *comp = malloc(2 * len + 16), *out = malloc(len + 1);
+    fill(src, len, pattern);
+
+    size_t clen = lz_compress(src, len, comp, 2 * len + 16);
+    if (clen == 0 || lz_decompress(comp, clen, out, len) != len || memcmp(src, out, len) != 0) {
+        fprintf(stderr, "FAIL buffer round trip: %zu bytes, pattern %d\n", len, pattern);
+        failures += 1;
+    }
+    free(src);
+    free(comp);
+    free(out);
+}
+
+// Helper function to compress and decompress len bytes of one pattern
+// through files, checking the result matches.
+//
+// Returns the compressed file, rewound, for the corruption tests.
+FILE *check_file(size_t len, int pattern) {
+    uint8_t *src = malloc(len + 1);
+    fill(src, len, pattern);
+    FILE *infile = tmpfile(), *comp = tmpfile(), *out = tmpfile();
+    if (infile == NULL || comp == NULL || out == NULL) {
+        perror("Failed");
+        exit(1);
+    }
+    fwrite(src, 1, len, infile);
+    rewind(infile);
+
+    bool ok = lz_compress_file(infile, comp);
+    rewind(comp);
+    ok = ok == true && lz_decompress_file(comp, out);
+    rewind(comp);
+    rewind(out);
+
+    uint8_t *back = malloc(len + 1);
+    ok = ok == true && fread(back, 1, len + 1, out) == len && memcmp(src, back, len) == 0;
+    if (ok == false) {
+        fprintf(stderr, "FAIL file round trip: %zu bytes, pattern %d\n", len, pattern);
+        failures += 1;
+    }
+
+    free(src);
+    free(back);
+    fclose(infile);
+    fclose(out);
+    return comp;
+}
+
+// Helper function to read all of file into a new buffer.
+//
+// Returns the buffer, setting len to its length.
+uint8_t *slurp(FILE *file, size_t *len) {
+    fseek(file, 0, SEEK_END);
+    *len = ftell(file);
+    rewind(file);
+    uint8_t *buf = malloc(*len + 1);
+    if (fread(buf, 1, *len, file) != *len) {
+        perror("Failed");
+        exit(1);
+    }
+    return buf;
+}
+
+// Helper function to decompress len bytes of corrupt as a file.
+//
+// Returns true if the decoder accepted it, setting out to its output.
+bool decode_bytes(const uint8_t *corrupt, size_t len, uint8_t **out, size_t *outlen) {
+    FILE *infile = tmpfile(), *outfile = tmpfile();
+    if (infile == NULL || outfile == NULL) {
+        perror("Failed");
+        exit(1);
+    }
+    fwrite(corrupt, 1, len, infile);
+    rewind(infile);
+    bool ok = lz_decompress_file(infile, outfile);
+    *out = slurp(outfile, outlen);
+    fclose(infile);
+    fclose(outfile);
+    return ok;
+}
+
+// Helper function to check that truncations of a compressed file are
+// rejected, and that flipped bytes are either rejected or decode to no
+// more than a frame per header, without reading or writing out of
+// bounds.
+void check_corrupt(FILE *comp) {
+    size_t len;
+    uint8_t *good = slurp(comp, &len);
+    uint8_t *bad = malloc(len + 1);
+    uint8_t *out;
+    size_t outlen;
+
+    for (size_t cut = 1; cut < len; cut += cut < 64 ? 1 : len / 97 + 1) {
+        if (decode_bytes(good, cut, &out, &outlen) == true) {
+            fprintf(stderr, "FAIL truncated input accepted: %zu of %zu bytes\n", cut, len);
+            failures += 1;
+        }
+        free(out);
+    }
+
+    for (int trial = 0; trial < 500; trial++) {
+        memcpy(bad, good, len);
+        int flips = next_random() % 4 + 1;
+        for (int f = 0; f < flips; f++) {
+            bad[next_random() % len] ^= (uint8_t) (next_random() % 255 + 1);
+        }
+        bool ok = decode_bytes(bad, len, &out, &outlen);
+        if (ok == true && outlen > LZ_FRAME_SIZE * (len / 8)) {
+            fprintf(stderr, "FAIL corrupt input decoded to %zu bytes\n", outlen);
+            failures += 1;
+        }
+        free(out);
+    }
+
+    // Frame headers claiming too much, or a stored frame whose lengths
+    // disagree, are rejected outright.
+    uint8_t header[8] = { 0, 2, 0, 0, 0, 0, 0, 1 };
+    if (decode_bytes(header, sizeof(header), &out, &outlen) == true) {
+        fprintf(stderr, "FAIL oversized frame accepted\n");
+        failures += 1;
+    }
+    free(out);
+    uint8_t stored[10] = { 0, 0, 0, 1, 0x80, 0, 0, 2, 'a', 'b' };
+    if (decode_bytes(stored, sizeof(stored), &out, &outlen) == true) {
+        fprintf(stderr, "FAIL mismatched stored frame accepted\n");
+        failures += 1;
+    }
+    free(out);
+
+    free(good);
+    free(bad);
+}
+
+// Main function. Checks that the LZ codec round trips, and that the
+// decoder rejects corrupt input.
+// Returns 0 if every check passes, 1 otherwise.
+int main(void) {
+    // Lengths around the token nibble (15) and the length byte (255)
+    // limits, and a whole frame.
+    static const size_t lengths[] = { 1, 4, 5, 14, 15, 16, 19, 20, 269, 270, 271, 525, 4096,
+        LZ_FRAME_SIZE };
+    for (int pattern = 0; pattern < 4; pattern++) {
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            check_buffer(lengths[i], pattern);
+        }
+    }
+
+    // Files of whole, partial and several frames.
+    static const size_t sizes[] = { 0, 1, LZ_FRAME_SIZE - 1, LZ_FRAME_SIZE, LZ_FRAME_SIZE + 1,
+        3 * LZ_FRAME_SIZE + 17 };
+    for (int pattern = 0; pattern < 4; pattern++) {
+        for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+            fclose(check_file(sizes[i], pattern));
+        }
+    }
+
+    // Corruption of a compressible file and of one with stored frames.
+    for (int pattern = 1; pattern < 4; pattern++) {
+        FILE *comp = check_file(2 * LZ_FRAME_SIZE + 100, pattern);
+        check_corrupt(comp);
+        fclose(comp);
+    }
+
+    if (failures == 0) {
+        printf("lz: all tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "rsa.h"
+
+// Main function. Takes input from the command line.
+// Returns 0 if the shards were merged, 1 otherwise.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    bool verbose = false;
+    bool gotoutfile = false;
+    FILE *outfile;
+
+    // Parse command line options.
+    while ((opt = getopt(argc, argv, "hvo:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Merges shards written by encrypt -S/-R or decrypt -S/-R into "
+                   "the\n   file a single run would have written.\n\nUSAGE\n   ./merge [-hv] "
+                   "[-o outfile] shard...\n\nOPTIONS\n   -h              Display program help "
+                   "and usage.\n   -v              Display verbose program output.\n   -o "
+                   "outfile      Output file for merged data (default: stdout).\n\n   Shards may "
+                   "be given in any order, but must cover the whole input.\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'o':
+            outfile = fopen(optarg, "w");
+            if (outfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotoutfile = true;
+            break;
+        }
+    }
+
+    if (gotoutfile == false) {
+        outfile = stdout;
+    }
+
+    // Open the shards named after the options.
+    uint64_t count = argc - optind;
+    FILE **shards = calloc(count + 1, sizeof(FILE *));
+    for (uint64_t i = 0; i < count; i++) {
+        shards[i] = fopen(argv[optind + i], "r");
+        if (shards[i] == NULL) {
+            perror("Failed");
+            return 1;
+        }
+    }
+    if (verbose == true) {
+        fprintf(stderr, "merging %" PRIu64 " shards\n", count);
+    }
+
+    // Merging. Nothing is written unless the shards fit together.
+    bool ok = rsa_merge_shards(shards, count, outfile);
+    if (ok == false) {
+        fprintf(stderr, "Unable to merge; shards are missing, overlap, come from "
+                        "different inputs or keys, or couldn't be copied.\n");
+    }
+
+    // Termination.
+    for (uint64_t i = 0; i < count; i++) {
+        fclose(shards[i]);
+    }
+    if (gotoutfile == true) {
+        fclose(outfile);
+    }
+    free(shards);
+    return ok == true ? 0 : 1;
+}
@@ -2,8 +2,6 @@
 #include "randstate.h"
 #include <gmp.h>
 
-gmp_randstate_t state;
-
 // Function to calculate the greatest common denominator
 // of two mpz_t's, a and b, and place the result in the
 // mpz_t d.
@@ -74,11 +72,90 @@ void mod_inverse(mpz_t i, mpz_t a, mpz_t n) {
     mpz_clears(e, r, q, temp_r, temp_e, temp_qe, t, y, temp_t, temp_y, temp_qy, NULL);
 }
 
+// Width in bits of the exponent windows used by pow_mod. Set once at
+// startup, before any threads are started.
+static uint64_t window = 1;
+
+// Function to set the window width used by pow_mod, from 1 (plain
+// square and multiply) up to POW_MOD_MAX_WINDOW.
+void pow_mod_set_window(uint64_t width) {
+    if (width < 1) {
+        width = 1;
+    }
+    window = width < POW_MOD_MAX_WINDOW ? width : POW_MOD_MAX_WINDOW;
+}
+
+// Function to calculate out = base^exponent mod modulus with a sliding
+// window, which trades a table of the odd powers of base below
+// 2^window for fewer multiplications as the exponent is scanned.
+static void pow_mod_sliding(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
+    uint64_t nodd = (uint64_t) 1 << (window - 1);
+    mpz_t table[1 << (POW_MOD_MAX_WINDOW - 1)];
+    mpz_t v, sq, temp;
+    mpz_inits(v, sq, temp, NULL);
+
+    // table[i] holds base^(2i + 1) mod modulus.
+    mpz_init(table[0]);
+    mpz_mod(table[0], base, modulus);
+    mpz_mul(temp, table[0], table[0]);
+    mpz_mod(sq, temp, modulus);
+    for (uint64_t i = 1; i < nodd; i++) {
+        mpz_init(table[i]);
+        mpz_mul(temp, table[i - 1], sq);
+        mpz_mod(table[i], temp, modulus);
+    }
+
+    mpz_set_ui(v, 1);
+    int64_t i = (int64_t) mpz_sizeinbase(exponent, 2) - 1;
+    if (mpz_sgn(exponent) == 0) {
+        i = -1;
+    }
+    while (i >= 0) {
+        if (mpz_tstbit(exponent, i) == 0) {
+            mpz_mul(temp, v, v);
+            mpz_mod(v, temp, modulus);
+            i -= 1;
+            continue;
+        }
+
+        // Take the longest window of at most window bits ending in a 1.
+        int64_t low = i - (int64_t) window + 1;
+        low = low > 0 ? low : 0;
+        while (mpz_tstbit(exponent, low) == 0) {
+            low += 1;
+        }
+        uint64_t bits = 0;
+        for (int64_t j = i; j >= low; j--) {
+            bits = (bits << 1) | mpz_tstbit(exponent, j);
+            mpz_mul(temp, v, v);
+            mpz_mod(v, temp, modulus);
+        }
+        mpz_mul(temp, v, table[bits >> 1]);
+        mpz_mod(v, temp, modulus);
+        i = low - 1;
+    }
+    mpz_mod(out, v, modulus);
+
+    for (uint64_t j = 0; j < nodd; j++) {
+        mpz_clear(table[j]);
+    }
+    mpz_clears(v, sq, temp, NULL);
+}
+
 // Function to calculate the power modulus of mpz_t base,
 // using mpz_t exponent as the exponent and mpz_t modulus
 // as the modulus, and passing the calculated value out through
 // mpz_t out.
+//
+// With a window width above 1, set by pow_mod_set_window, the exponent
+// is instead scanned from the top in windows of up to that many bits,
+// each costing one multiplication by a precomputed odd power of base.
 void pow_mod(mpz_t out, mpz_t base, mpz_t exponent, mpz_t modulus) {
+    if (window > 1) {
+        pow_mod_sliding(out, base, exponent, modulus);
+        return;
+    }
+
     mpz_t v, p, temp_exp, temp_mod, temp_vp, temp_pp;
     mpz_inits(temp_vp, temp_pp, NULL);
     mpz_init_set_ui(v, 1);
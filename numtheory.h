@@ -5,10 +5,15 @@
 #include <stdio.h>
 #include <gmp.h>
 
+// Widest exponent window pow_mod can be set to use.
+#define POW_MOD_MAX_WINDOW 8
+
 void gcd(mpz_t g, mpz_t a, mpz_t b);
 
 void mod_inverse(mpz_t o, mpz_t a, mpz_t n);
 
+void pow_mod_set_window(uint64_t width);
+
 void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
 
 bool is_prime(mpz_t n, uint64_t iters);
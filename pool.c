@@ -0,0 +1,219 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <gmp.h>
+
+#include "pool.h"
+
+// Blocks are pooled in power of two size classes from 16 bytes to
+// 64 KiB. Anything larger goes straight to the system allocator.
+#define POOL_MIN_SHIFT 4
+#define POOL_MAX_SHIFT 16
+#define POOL_CLASSES   (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_SLAB_SIZE (1 << 16)
+#define POOL_BATCH     32
+#define POOL_CACHE_MAX 256
+
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block;
+
+// Free blocks cached by one thread, which it allocates from without
+// taking any lock.
+typedef struct {
+    pool_block *head[POOL_CLASSES];
+    uint32_t count[POOL_CLASSES];
+} pool_cache;
+
+static _Thread_local pool_cache cache;
+
+// Free blocks shared between threads. Threads only touch the depot to
+// move blocks in or out a batch at a time.
+static pool_block *depot[POOL_CLASSES];
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool pool_lock = false;
+
+// Called through a volatile pointer so zeroing freed key material isn't
+// optimized away.
+static void *(*volatile pool_memset)(void *, int, size_t) = memset;
+
+// Function to stop with message when memory runs out or can't be
+// locked, as GMP's own allocator does.
+static void pool_fail(const char *message) {
+    fprintf(stderr, "%s\n", message);
+    abort();
+}
+
+// Function to find the size class of an allocation of size bytes.
+//
+// Returns the class, or POOL_CLASSES if it is too large to pool.
+static int pool_class(size_t size) {
+    if (size <= (1 << POOL_MIN_SHIFT)) {
+        return 0;
+    }
+    if (size > (1 << POOL_MAX_SHIFT)) {
+        return POOL_CLASSES;
+    }
+    return 64 - __builtin_clzll(size - 1) - POOL_MIN_SHIFT;
+}
+
+// Function to map fresh memory, locking it in RAM if requested. Memory
+// that can't be locked is never handed out, since it could be swapped.
+static void *pool_map(size_t size) {
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        pool_fail("Unable to allocate memory.");
+    }
+    if (pool_lock == true && mlock(mem, size) != 0) {
+        pool_fail("Unable to lock memory; raise the locked memory limit (ulimit -l).");
+    }
+    return mem;
+}
+
+// Function to refill the calling thread's cache for class c, from the
+// depot if it has blocks and from a new slab otherwise. Called with the
+// depot locked.
+static void pool_refill(int c) {
+    for (int i = 0; i < POOL_BATCH && depot[c] != NULL; i++) {
+        pool_block *b = depot[c];
+        depot[c] = b->next;
+        b->next = cache.head[c];
+        cache.head[c] = b;
+        cache.count[c] += 1;
+    }
+    if (cache.head[c] != NULL) {
+        return;
+    }
+
+    size_t size = (size_t) 1 << (c + POOL_MIN_SHIFT);
+    uint8_t *slab = pool_map(POOL_SLAB_SIZE);
+    for (size_t off = 0; off + size <= POOL_SLAB_SIZE; off += size) {
+        pool_block *b = (pool_block *) &slab[off];
+        b->next = cache.head[c];
+        cache.head[c] = b;
+        cache.count[c] += 1;
+    }
+}
+
+// Function to move count blocks of class c from the calling thread's
+// cache into the depot.
+static void pool_flush(int c, uint32_t count) {
+    pthread_mutex_lock(&depot_lock);
+    for (uint32_t i = 0; i < count && cache.head[c] != NULL; i++) {
+        pool_block *b = cache.head[c];
+        cache.head[c] = b->next;
+        cache.count[c] -= 1;
+        b->next = depot[c];
+        depot[c] = b;
+    }
+    pthread_mutex_unlock(&depot_lock);
+}
+
+static void *pool_alloc(size_t size) {
+    int c = pool_class(size);
+    if (c == POOL_CLASSES) {
+        if (pool_lock == true) {
+            return pool_map(size);
+        }
+        void *mem = malloc(size);
+        if (mem == NULL) {
+            pool_fail("Unable to allocate memory.");
+        }
+        return mem;
+    }
+
+    if (cache.head[c] == NULL) {
+        pthread_mutex_lock(&depot_lock);
+        pool_refill(c);
+        pthread_mutex_unlock(&depot_lock);
+    }
+    pool_block *b = cache.head[c];
+    cache.head[c] = b->next;
+    cache.count[c] -= 1;
+    return b;
+}
+
+static void pool_free(void *ptr, size_t size) {
+    int c = pool_class(size);
+    if (c == POOL_CLASSES) {
+        if (pool_lock == true) {
+            munmap(ptr, size);
+        } else {
+            free(ptr);
+        }
+        return;
+    }
+
+    // Blocks are zeroed before reuse when they may hold key material.
+    if (pool_lock == true) {
+        pool_memset(ptr, 0, size);
+    }
+
+    pool_block *b = ptr;
+    b->next = cache.head[c];
+    cache.head[c] = b;
+    cache.count[c] += 1;
+    if (cache.count[c] > POOL_CACHE_MAX) {
+        pool_flush(c, POOL_CACHE_MAX / 2);
+    }
+}
+
+static void *pool_realloc(void *ptr, size_t old_size, size_t new_size) {
+    int c = pool_class(new_size);
+    if (c != POOL_CLASSES && c == pool_class(old_size)) {
+        return ptr;
+    }
+    if (c == POOL_CLASSES && pool_class(old_size) == POOL_CLASSES && pool_lock == false) {
+        void *mem = realloc(ptr, new_size);
+        if (mem == NULL) {
+            pool_fail("Unable to allocate memory.");
+        }
+        return mem;
+    }
+
+    void *mem = pool_alloc(new_size);
+    memcpy(mem, ptr, old_size < new_size ? old_size : new_size);
+    pool_free(ptr, old_size);
+    return mem;
+}
+
+// Function to make GMP allocate through the pool. Must be called before
+// any GMP value is initialized, since blocks from the default allocator
+// can't be freed into the pool. If lock is true, every GMP allocation,
+// not just those holding keys, is locked in RAM with mlock so none of it
+// is ever swapped out, and blocks are zeroed when freed. The probe here
+// only checks that locking is allowed at all; running out of lockable
+// memory later stops the program rather than leaving memory unlocked.
+//
+// Returns true on success, false if memory couldn't be locked.
+bool pool_init(bool lock) {
+    if (lock == true) {
+        // Check that locking is allowed before relying on it.
+        void *probe = mmap(NULL, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (probe == MAP_FAILED) {
+            return false;
+        }
+        bool locked = mlock(probe, POOL_SLAB_SIZE) == 0;
+        munmap(probe, POOL_SLAB_SIZE);
+        if (locked == false) {
+            return false;
+        }
+        pool_lock = true;
+    }
+    mp_set_memory_functions(pool_alloc, pool_realloc, pool_free);
+    return true;
+}
+
+// Function to hand the calling thread's cached blocks back to the depot,
+// so other threads can reuse them. Worker threads call this before they
+// exit.
+void pool_thread_release(void) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        pool_flush(c, cache.count[c]);
+    }
+}
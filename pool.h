@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+bool pool_init(bool lock);
+
+void pool_thread_release(void);
@@ -1,7 +1,7 @@
 #include "randstate.h"
 #include <gmp.h>
 
-gmp_randstate_t state;
+_Thread_local gmp_randstate_t state;
 
 // Function to initialize the random state.
 void randstate_init(uint64_t seed) {
@@ -9,6 +9,17 @@ void randstate_init(uint64_t seed) {
     gmp_randseed_ui(state, seed);
 }
 
+// Function to initialize the random state from a seed of len bytes,
+// for seeds wider than a uint64_t.
+void randstate_init_bytes(const uint8_t seed[], size_t len) {
+    mpz_t s;
+    mpz_init(s);
+    mpz_import(s, len, 1, 1, 1, 0, seed);
+    gmp_randinit_mt(state);
+    gmp_randseed(state, s);
+    mpz_clear(s);
+}
+
 // Function to clear the random state.
 void randstate_clear(void) {
     gmp_randclear(state);
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <gmp.h>
 
-extern gmp_randstate_t state;
+// Each thread has its own random state, so keys can be generated on
+// several threads at once.
+extern _Thread_local gmp_randstate_t state;
 
 void randstate_init(uint64_t seed);
 
+void randstate_init_bytes(const uint8_t seed[], size_t len);
+
 void randstate_clear(void);
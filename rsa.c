@@ -1,9 +1,14 @@
+#include <inttypes.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include "jobs.h"
 #include "rsa.h"
 #include "numtheory.h"
-
-gmp_randstate_t state;
+#include "pool.h"
+#include "randstate.h"
+#include "sha256.h"
 
 // Function to create the public rsa key.
 // Accepts two mpz_t primes as input, as well as two
@@ -62,11 +67,11 @@ void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
 
 // Function to read a public key from the public key file, and use
 // the information to fill mpz_t's n, e, and s, as well as char
-// array username.
+// array username, which must hold at least 256 characters.
 //
 // Returns nothing, just fills variables.
 void rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
-    gmp_fscanf(pbfile, "%Zx\n%Zx\n%Zx\n%s\n", n, e, s, username);
+    gmp_fscanf(pbfile, "%Zx\n%Zx\n%Zx\n%255s\n", n, e, s, username);
 }
 
 // Function to make the necessary variables for the private key.
@@ -106,49 +111,75 @@ void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) {
     pow_mod(c, m, e, n);
 }
 
-// Function to encrypt file infile, using mpz_t's n and e.
-//
-// Returns nothing, just outputs the encrypted file to outfile.
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
-    mpz_t k, logn, logn_minus_one, c, m;
-    mpz_inits(k, logn, logn_minus_one, c, m, NULL);
-
-    // Calculate k.
-    mpz_set_ui(logn, mpz_sizeinbase(n, 2));
-
-    mpz_sub_ui(logn_minus_one, logn, 1);
-    mpz_fdiv_q_ui(k, logn_minus_one, 8);
+// Progress of rsa_encrypt_blocks through its input and output.
+typedef struct {
+    uint64_t plain; // Bytes of input encrypted.
+    uint64_t cipher; // Offset in the output of the next block.
+    uint64_t blocks; // Blocks written.
+} block_count;
 
-    // Allocate block array.
-    uint64_t ki = mpz_get_ui(k);
+// Function to encrypt the first fill bytes after the 0xFF marker of a
+// block and write it as a line of hex. gmp_fprintf doesn't report write
+// errors itself, so the stream's error flag is checked too.
+//
+// Returns the number of bytes written, or -1 if writing failed.
+static int rsa_encrypt_block(
+    FILE *outfile, uint8_t *block, uint64_t fill, mpz_t c, mpz_t m, mpz_t e, mpz_t n) {
+    mpz_import(m, fill + 1, 1, 1, 1, 0, block);
+    rsa_encrypt(c, m, e, n);
+    int written = gmp_fprintf(outfile, "%Zx\n", c);
+    return written > 0 && ferror(outfile) == 0 ? written : -1;
+}
 
-    uint8_t *block;
-    if (ki != 0) {
-        block = calloc(ki, sizeof(uint8_t));
-    } else {
-        block = calloc(1, sizeof(uint8_t));
+// Function to encrypt up to limit bytes of infile in blocks of k - 1
+// bytes, using mpz_t's n and e, counting them in done. If index isn't
+// NULL, an entry giving the plaintext and ciphertext offset of each
+// block is written to it.
+//
+// Returns true on success, false if reading or writing failed.
+static bool rsa_encrypt_blocks(FILE *infile, FILE *outfile, mpz_t n, mpz_t e, uint64_t limit,
+    FILE *index, block_count *done) {
+    uint64_t ki = (mpz_sizeinbase(n, 2) - 1) / 8;
+    if (ki < 2) {
+        return false;
     }
-
-    uint8_t workaround = 0xFF;
-    block[0] = workaround;
-
-    // Encryption.
-    mpz_sub_ui(k, k, 1);
+    uint8_t *block = calloc(ki, sizeof(uint8_t));
+    if (block == NULL) {
+        return false;
+    }
+    block[0] = 0xFF;
     ki -= 1;
-    uint64_t nbytes = fread(&block[1], 1, ki, infile);
-    while (nbytes != 0) {
-        if (nbytes < ki) {
-            ki = nbytes;
-        }
 
-        mpz_import(m, ki + 1, 1, 1, 1, 0, block);
-        rsa_encrypt(c, m, e, n);
-        gmp_fprintf(outfile, "%Zx\n", c);
-        nbytes = fread(&block[1], 1, ki, infile);
+    mpz_t c, m;
+    mpz_inits(c, m, NULL);
+    bool ok = true;
+    while (ok == true && done->plain < limit) {
+        uint64_t want = limit - done->plain < ki ? limit - done->plain : ki;
+        uint64_t nbytes = fread(&block[1], 1, want, infile);
+        if (nbytes == 0) {
+            break;
+        }
+        if (index != NULL) {
+            ok = fprintf(index, RSA_INDEX_ENTRY, done->plain, done->cipher) > 0;
+        }
+        int written = rsa_encrypt_block(outfile, block, nbytes, c, m, e, n);
+        ok = ok == true && written > 0;
+        done->plain += nbytes;
+        done->cipher += written > 0 ? written : 0;
+        done->blocks += 1;
     }
 
     free(block);
-    mpz_clears(k, logn, logn_minus_one, c, m, NULL);
+    mpz_clears(c, m, NULL);
+    return ok == true && ferror(infile) == 0 && fflush(outfile) == 0;
+}
+
+// Function to encrypt file infile, using mpz_t's n and e.
+//
+// Returns nothing, just outputs the encrypted file to outfile.
+void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+    block_count done = { 0, 0, 0 };
+    rsa_encrypt_blocks(infile, outfile, n, e, UINT64_MAX, NULL, &done);
 }
 
 // Function to decrypt message c using mpz_t's d and n.
@@ -200,6 +231,567 @@ void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
     mpz_clears(k, logn, logn_minus_one, c, m, NULL);
 }
 
+// Function to write the header line of an encrypted file. Plain
+// encrypted files have no header, so nothing is written if flags is 0.
+//
+// Returns the number of bytes written.
+uint64_t rsa_write_header(FILE *outfile, uint32_t flags) {
+    if (flags == 0) {
+        return 0;
+    }
+    int written = fprintf(outfile, "#rsa%s%s\n", (flags & RSA_FLAG_INDEX) ? " idx" : "",
+        (flags & RSA_FLAG_LZ) ? " lz" : "");
+    return written > 0 ? written : 0;
+}
+
+// Function to read the header line of an encrypted file, if it has one.
+// Ciphertext lines are hex, so a header is told apart by its leading '#'.
+//
+// Returns the flags in the header, or 0 if there is no header.
+uint32_t rsa_read_header(FILE *infile) {
+    int ch = getc(infile);
+    if (ch != '#') {
+        if (ch != EOF) {
+            ungetc(ch, infile);
+        }
+        return 0;
+    }
+
+    char line[128];
+    uint32_t flags = 0;
+    if (fgets(line, sizeof(line), infile) != NULL) {
+        for (char *tok = strtok(line, " \n"); tok != NULL; tok = strtok(NULL, " \n")) {
+            if (strcmp(tok, "idx") == 0) {
+                flags |= RSA_FLAG_INDEX;
+            } else if (strcmp(tok, "lz") == 0) {
+                flags |= RSA_FLAG_LZ;
+            }
+        }
+    }
+    return flags;
+}
+
+// Function to encrypt file infile into an indexed container, using
+// mpz_t's n and e. The ciphertext blocks are the same as those written
+// by rsa_encrypt_file, but they are followed by an index that records
+// the plaintext and ciphertext offset of every block, and a fixed width
+// footer that locates the index. This lets rsa_decrypt_range seek
+// straight to the blocks it needs.
+//
+// Returns true on success, false if the input couldn't be read or the
+// output or index couldn't be written.
+bool rsa_encrypt_file_indexed(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+    // Index entries are spilled to a temporary file as blocks are
+    // written, so memory use doesn't grow with the input.
+    FILE *index = tmpfile();
+    if (index == NULL) {
+        return false;
+    }
+
+    // Encryption.
+    block_count done = { 0, rsa_write_header(outfile, RSA_FLAG_INDEX), 0 };
+    bool ok = done.cipher > 0
+              && rsa_encrypt_blocks(infile, outfile, n, e, UINT64_MAX, index, &done);
+
+    // Append the index, then the footer pointing back at it.
+    ok = ok == true && fprintf(outfile, RSA_INDEX_HEADER, done.blocks, done.plain) > 0
+         && fflush(index) == 0 && fseeko(index, 0, SEEK_SET) == 0;
+    char entry[RSA_INDEX_ENTRY_SIZE + 1];
+    for (uint64_t i = 0; ok == true && i < done.blocks; i++) {
+        ok = fread(entry, 1, RSA_INDEX_ENTRY_SIZE, index) == RSA_INDEX_ENTRY_SIZE
+             && fwrite(entry, 1, RSA_INDEX_ENTRY_SIZE, outfile) == RSA_INDEX_ENTRY_SIZE;
+    }
+    ok = ok == true && fprintf(outfile, RSA_INDEX_FOOTER, done.cipher) > 0 && fflush(outfile) == 0;
+
+    fclose(index);
+    return ok;
+}
+
+// Function to read entry i of an index starting at entries.
+//
+// Returns true if the entry was read, false if it wasn't.
+static bool rsa_index_entry(FILE *infile, uint64_t entries, uint64_t i, uint64_t *plain,
+    uint64_t *cipher) {
+    if (fseeko(infile, entries + i * RSA_INDEX_ENTRY_SIZE, SEEK_SET) != 0) {
+        return false;
+    }
+    return fscanf(infile, "%" SCNx64 " %" SCNx64, plain, cipher) == 2;
+}
+
+// Function to decrypt len bytes of plaintext starting at byte start
+// from an indexed container written by rsa_encrypt_file_indexed, using
+// mpz_t's n and d. Only the blocks that overlap the range are read and
+// decrypted. The range is clipped to the end of the plaintext.
+//
+// Returns true on success, false if infile isn't a seekable indexed
+// container or outfile can't be written.
+bool rsa_decrypt_range(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t d, uint64_t start, uint64_t len) {
+    uint64_t index_pos, count, total;
+
+    // Find the index through the footer.
+    if (fseeko(infile, -RSA_INDEX_FOOTER_SIZE, SEEK_END) != 0
+        || fscanf(infile, RSA_INDEX_FOOTER_SCAN, &index_pos) != 1
+        || fseeko(infile, index_pos, SEEK_SET) != 0
+        || fscanf(infile, RSA_INDEX_HEADER_SCAN, &count, &total) != 2) {
+        return false;
+    }
+    uint64_t entries = index_pos + RSA_INDEX_HEADER_SIZE;
+
+    if (start >= total || len == 0 || count == 0) {
+        return true;
+    }
+    uint64_t end = (len > total - start) ? total : start + len;
+
+    // Binary search for the last block starting at or before start.
+    uint64_t lo = 0, hi = count - 1, plain, cipher;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        if (rsa_index_entry(infile, entries, mid, &plain, &cipher) == false) {
+            return false;
+        }
+        if (plain <= start) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    if (rsa_index_entry(infile, entries, lo, &plain, &cipher) == false
+        || fseeko(infile, cipher, SEEK_SET) != 0) {
+        return false;
+    }
+
+    mpz_t c, m;
+    mpz_inits(c, m, NULL);
+    uint8_t *block = calloc(mpz_sizeinbase(n, 256) + 1, sizeof(uint8_t));
+    size_t j;
+
+    // Decrypt blocks until the end of the range is reached. Blocks are
+    // stored back to back, so no further seeks are needed.
+    bool ok = true;
+    while (plain < end) {
+        if (gmp_fscanf(infile, "%Zx\n", c) != 1) {
+            ok = false;
+            break;
+        }
+        rsa_decrypt(m, c, d, n);
+        mpz_export(block, &j, 1, 1, 1, 0, m);
+
+        uint64_t nbytes = j > 0 ? j - 1 : 0;
+        uint64_t from = start > plain ? start - plain : 0;
+        uint64_t to = end - plain < nbytes ? end - plain : nbytes;
+        if (from < to && fwrite(&block[1 + from], 1, to - from, outfile) != to - from) {
+            ok = false;
+            break;
+        }
+        plain += nbytes;
+    }
+
+    free(block);
+    mpz_clears(c, m, NULL);
+    return ok == true && fflush(outfile) == 0;
+}
+
+// Input shared by the workers of rsa_encrypt_file_multi. The input is
+// read into two buffers in turn, so the next chunk is read while the
+// workers encrypt the current one.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t done;
+    uint8_t *buf[2];
+    uint64_t len[2];
+    uint64_t pending[2];
+    uint64_t seq;
+    bool eof;
+} shared_input;
+
+// One recipient of rsa_encrypt_file_multi, which packs the shared input
+// into blocks of its own size.
+typedef struct {
+    shared_input *in;
+    FILE *outfile;
+    mpz_ptr n;
+    mpz_ptr e;
+    bool ok; // Whether every block was written.
+} recipient;
+
+// Worker thread for one recipient. Every chunk of the input is packed
+// into blocks of k - 1 bytes, carrying any partial block over into the
+// next chunk, so the output matches that of rsa_encrypt_file.
+static void *rsa_recipient_worker(void *arg) {
+    recipient *r = arg;
+    shared_input *in = r->in;
+
+    mpz_t c, m;
+    mpz_inits(c, m, NULL);
+    uint64_t ki = (mpz_sizeinbase(r->n, 2) - 1) / 8;
+    uint8_t *block = ki >= 2 ? calloc(ki, sizeof(uint8_t)) : NULL;
+    if (block != NULL) {
+        block[0] = 0xFF;
+        ki -= 1;
+    } else {
+        r->ok = false;
+    }
+    uint64_t fill = 0;
+
+    for (uint64_t next = 0;; next++) {
+        pthread_mutex_lock(&in->lock);
+        while (in->seq <= next && in->eof == false) {
+            pthread_cond_wait(&in->ready, &in->lock);
+        }
+        if (in->seq <= next) {
+            pthread_mutex_unlock(&in->lock);
+            break;
+        }
+        pthread_mutex_unlock(&in->lock);
+
+        // Without a block, chunks are still taken, so the reader isn't
+        // left waiting on this worker.
+        uint8_t *buf = in->buf[next % 2];
+        uint64_t len = block != NULL ? in->len[next % 2] : 0;
+        for (uint64_t off = 0; off < len;) {
+            uint64_t take = ki - fill < len - off ? ki - fill : len - off;
+            memcpy(&block[1 + fill], &buf[off], take);
+            fill += take;
+            off += take;
+            if (fill == ki) {
+                r->ok = rsa_encrypt_block(r->outfile, block, fill, c, m, r->e, r->n) > 0
+                        && r->ok == true;
+                fill = 0;
+            }
+        }
+
+        pthread_mutex_lock(&in->lock);
+        in->pending[next % 2] -= 1;
+        if (in->pending[next % 2] == 0) {
+            pthread_cond_signal(&in->done);
+        }
+        pthread_mutex_unlock(&in->lock);
+    }
+
+    if (fill > 0) {
+        r->ok = rsa_encrypt_block(r->outfile, block, fill, c, m, r->e, r->n) > 0 && r->ok == true;
+    }
+    r->ok = fflush(r->outfile) == 0 && r->ok == true;
+
+    free(block);
+    mpz_clears(c, m, NULL);
+    pool_thread_release();
+    return NULL;
+}
+
+// Function to encrypt infile once for each of count recipients, using
+// mpz_t's n[i] and e[i] and writing to outfiles[i]. The input is read
+// only once, in chunks of bufsize bytes that every recipient's worker
+// thread encrypts in parallel. Each output is the same as
+// rsa_encrypt_file would write for that recipient.
+//
+// Returns true on success, false if a key is too small to hold a block,
+// the workers couldn't be started or an output couldn't be written.
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfiles[], mpz_ptr n[], mpz_ptr e[],
+    uint64_t count, uint64_t bufsize) {
+    shared_input in;
+    memset(&in, 0, sizeof(in));
+    pthread_mutex_init(&in.lock, NULL);
+    pthread_cond_init(&in.ready, NULL);
+    pthread_cond_init(&in.done, NULL);
+    in.buf[0] = malloc(bufsize);
+    in.buf[1] = malloc(bufsize);
+
+    recipient *rs = calloc(count, sizeof(recipient));
+    bool ok = in.buf[0] != NULL && in.buf[1] != NULL && rs != NULL;
+    for (uint64_t i = 0; ok == true && i < count; i++) {
+        rs[i] = (recipient) { &in, outfiles[i], n[i], e[i], true };
+        ok = (mpz_sizeinbase(n[i], 2) - 1) / 8 >= 2;
+    }
+
+    // Every recipient must be running for the chunks to be shared out.
+    // If any can't be started, no input is read, and the workers that
+    // jobs_finish runs late find the input already at its end.
+    job_group workers = { NULL, NULL, 0, 0, 0, NULL };
+    ok = ok == true && jobs_start(&workers, rsa_recipient_worker, rs, count, sizeof(recipient));
+
+    // Read chunks into alternate buffers, waiting for the workers to
+    // finish with a buffer before reading into it again.
+    pthread_mutex_lock(&in.lock);
+    while (ok == true) {
+        uint64_t slot = in.seq % 2;
+        while (in.pending[slot] > 0) {
+            pthread_cond_wait(&in.done, &in.lock);
+        }
+        pthread_mutex_unlock(&in.lock);
+        uint64_t nbytes = fread(in.buf[slot], 1, bufsize, infile);
+        pthread_mutex_lock(&in.lock);
+
+        if (nbytes == 0) {
+            break;
+        }
+        in.len[slot] = nbytes;
+        in.pending[slot] = count;
+        in.seq += 1;
+        pthread_cond_broadcast(&in.ready);
+    }
+    in.eof = true;
+    pthread_cond_broadcast(&in.ready);
+    pthread_mutex_unlock(&in.lock);
+
+    jobs_finish(&workers);
+    for (uint64_t i = 0; ok == true && i < count; i++) {
+        ok = rs[i].ok;
+    }
+
+    pthread_mutex_destroy(&in.lock);
+    pthread_cond_destroy(&in.ready);
+    pthread_cond_destroy(&in.done);
+    free(in.buf[0]);
+    free(in.buf[1]);
+    free(rs);
+    return ok;
+}
+
+// Function to find the size of a seekable input, leaving it rewound.
+//
+// Returns true if the size was found, false if infile can't seek.
+static bool rsa_input_size(FILE *infile, uint64_t *size) {
+    off_t end;
+    if (fseeko(infile, 0, SEEK_END) != 0 || (end = ftello(infile)) < 0
+        || fseeko(infile, 0, SEEK_SET) != 0) {
+        return false;
+    }
+    *size = end;
+    return true;
+}
+
+// Function to write the first RSA_SHARD_ID_SIZE - 1 hex digits of a
+// digest into id.
+static void rsa_shard_id(char id[], uint8_t digest[]) {
+    for (int i = 0; i < (RSA_SHARD_ID_SIZE - 1) / 2; i++) {
+        snprintf(&id[2 * i], 3, "%02x", digest[i]);
+    }
+}
+
+// Function to find the ids a shard records, so that only shards of the
+// same input under the same key are merged: a hash of the input's size
+// and of RSA_SHARD_SAMPLES chunks of it at fixed offsets, and the hash
+// of the modulus n. Every shard reads the same few chunks, so the cost
+// doesn't grow with the input or the number of shards.
+//
+// Returns true on success, false if infile couldn't be read.
+static bool rsa_shard_ids(char input[], char key[], FILE *infile, uint64_t total, mpz_t n) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    uint8_t chunk[RSA_SHARD_CHUNK];
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    for (int j = 0; j < 8; j++) {
+        chunk[j] = (uint8_t) (total >> (56 - 8 * j));
+    }
+    sha256_update(&ctx, chunk, 8);
+
+    // Chunks are spread evenly from the start to the end of the input,
+    // and overlap, each being the whole input, if it is small.
+    uint64_t size = total < RSA_SHARD_CHUNK ? total : RSA_SHARD_CHUNK;
+    uint64_t step = (total - size) / (RSA_SHARD_SAMPLES - 1);
+    for (int i = 0; i < RSA_SHARD_SAMPLES; i++) {
+        uint64_t off = i == RSA_SHARD_SAMPLES - 1 ? total - size : step * i;
+        if (fseeko(infile, off, SEEK_SET) != 0 || fread(chunk, 1, size, infile) != size) {
+            return false;
+        }
+        sha256_update(&ctx, chunk, size);
+    }
+    sha256_final(&ctx, digest);
+    rsa_shard_id(input, digest);
+
+    size_t len = 0;
+    uint8_t *bytes = calloc(mpz_sizeinbase(n, 256) + 1, sizeof(uint8_t));
+    mpz_export(bytes, &len, 1, 1, 1, 0, n);
+    sha256(digest, bytes, len);
+    free(bytes);
+    rsa_shard_id(key, digest);
+    return true;
+}
+
+// Function to find the byte range of shard index of count, splitting
+// a seekable input into count near equal parts.
+//
+// Returns true on success, false if infile can't seek.
+bool rsa_shard_bounds(
+    FILE *infile, uint64_t index, uint64_t count, uint64_t *start, uint64_t *end) {
+    uint64_t total;
+    if (count == 0 || index >= count || rsa_input_size(infile, &total) == false) {
+        return false;
+    }
+    *start = total / count * index + total % count * index / count;
+    *end = total / count * (index + 1) + total % count * (index + 1) / count;
+    return true;
+}
+
+// Function to encrypt the bytes from start up to end of a seekable
+// infile, using mpz_t's n and e. Both ends are moved down to a block
+// boundary (an end at or past the end of the input is kept there), so
+// shards over adjacent ranges hold exactly the blocks rsa_encrypt_file
+// would write for that part of the input. The blocks follow a shard
+// header recording the range they cover.
+//
+// Returns true on success, false if infile can't seek or be read, or
+// outfile can't be written.
+bool rsa_encrypt_shard(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t e, uint64_t start, uint64_t end) {
+    uint64_t total;
+    uint64_t ki = (mpz_sizeinbase(n, 2) - 1) / 8;
+    if (ki < 2 || rsa_input_size(infile, &total) == false) {
+        return false;
+    }
+
+    // Each block holds k - 1 bytes of input after the 0xFF marker.
+    ki -= 1;
+    end = end >= total ? total : end - end % ki;
+    start = start >= end ? end : start - start % ki;
+    char input[RSA_SHARD_ID_SIZE], key[RSA_SHARD_ID_SIZE];
+    if (rsa_shard_ids(input, key, infile, total, n) == false
+        || fseeko(infile, start, SEEK_SET) != 0) {
+        return false;
+    }
+
+    // Encryption. The input must still hold the whole range.
+    block_count done = { 0, 0, 0 };
+    return fprintf(outfile, RSA_SHARD_HEADER, "enc", input, key, start, end, total) > 0
+           && rsa_encrypt_blocks(infile, outfile, n, e, end - start, NULL, &done) == true
+           && done.plain == end - start;
+}
+
+// Function to decrypt the ciphertext blocks of a seekable, headerless
+// infile whose lines start from start up to end, using mpz_t's n and
+// d. A block belongs to the range holding the first byte of its line,
+// so shards over adjacent ranges decrypt every block exactly once. The
+// plaintext follows a shard header recording the range it covers, so the
+// whole range must decrypt for the shard to be usable.
+//
+// Returns true on success, false if infile can't seek, has a header, or
+// holds a line in the range that isn't a block of this key, or if
+// outfile can't be written.
+bool rsa_decrypt_shard(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t d, uint64_t start, uint64_t end) {
+    uint64_t total;
+    if (rsa_input_size(infile, &total) == false || getc(infile) == '#') {
+        return false;
+    }
+    end = end > total ? total : end;
+    start = start > end ? end : start;
+
+    // Skip forward to the first line starting at or after start.
+    char input[RSA_SHARD_ID_SIZE], key[RSA_SHARD_ID_SIZE];
+    if (rsa_shard_ids(input, key, infile, total, n) == false
+        || fseeko(infile, start > 0 ? start - 1 : 0, SEEK_SET) != 0) {
+        return false;
+    }
+    if (start > 0) {
+        int ch = getc(infile);
+        while (ch != '\n' && ch != EOF) {
+            ch = getc(infile);
+        }
+    }
+    if (fprintf(outfile, RSA_SHARD_HEADER, "dec", input, key, start, end, total) < 0) {
+        return false;
+    }
+
+    mpz_t c, m;
+    mpz_inits(c, m, NULL);
+    uint8_t *block = calloc(mpz_sizeinbase(n, 256) + 1, sizeof(uint8_t));
+    size_t j;
+
+    // Decryption. Every block must decrypt to one starting with the 0xFF
+    // marker, and the lines must run on to the end of the range, which
+    // a clean end of input always reaches since end is at most total.
+    off_t pos = ftello(infile);
+    bool ok = block != NULL;
+    while (ok == true && pos >= 0 && (uint64_t) pos < end) {
+        ok = gmp_fscanf(infile, "%Zx\n", c) == 1;
+        if (ok == true) {
+            rsa_decrypt(m, c, d, n);
+            mpz_export(block, &j, 1, 1, 1, 0, m);
+            ok = j > 0 && block[0] == 0xFF && fwrite(&block[1], 1, j - 1, outfile) == j - 1;
+        }
+        pos = ftello(infile);
+    }
+
+    free(block);
+    mpz_clears(c, m, NULL);
+    return ok == true && pos >= 0 && (uint64_t) pos >= end && fflush(outfile) == 0;
+}
+
+// A shard read back by rsa_merge_shards.
+typedef struct {
+    FILE *file;
+    char kind[4];
+    char input[RSA_SHARD_ID_SIZE];
+    char key[RSA_SHARD_ID_SIZE];
+    uint64_t start;
+    uint64_t end;
+    uint64_t total;
+} shard;
+
+// Function to order shards by the range they cover, for qsort().
+static int rsa_shard_cmp(const void *a, const void *b) {
+    const shard *x = a, *y = b;
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    return x->end < y->end ? -1 : x->end > y->end;
+}
+
+// Function to merge shards written by rsa_encrypt_shard or
+// rsa_decrypt_shard, given in any order, into outfile. The shards must
+// all be of the same kind, made from the same input with the same key,
+// and together cover the whole of the input with no gaps or overlaps,
+// in which case the output is identical to that of rsa_encrypt_file or
+// rsa_decrypt_file.
+//
+// Returns true on success, false if the shards don't fit together or
+// couldn't be read, or outfile couldn't be written.
+bool rsa_merge_shards(FILE *shards[], uint64_t count, FILE *outfile) {
+    shard *ss = calloc(count, sizeof(shard));
+    bool ok = ss != NULL && count > 0;
+
+    // The header's newline is read on its own, since a scanf newline
+    // would also skip any whitespace bytes that start the payload.
+    for (uint64_t i = 0; ok == true && i < count; i++) {
+        ss[i].file = shards[i];
+        ok = fscanf(shards[i], RSA_SHARD_HEADER_SCAN, ss[i].kind, ss[i].input, ss[i].key,
+                 &ss[i].start, &ss[i].end, &ss[i].total)
+             == 6;
+        ok = ok == true && getc(shards[i]) == '\n';
+    }
+    if (ok == true) {
+        qsort(ss, count, sizeof(shard), rsa_shard_cmp);
+    }
+
+    // Check that the shards tile the input before writing anything.
+    uint64_t pos = 0;
+    for (uint64_t i = 0; ok == true && i < count; i++) {
+        ok = strcmp(ss[i].kind, ss[0].kind) == 0 && strcmp(ss[i].input, ss[0].input) == 0
+             && strcmp(ss[i].key, ss[0].key) == 0 && ss[i].total == ss[0].total
+             && ss[i].start == pos && ss[i].end >= ss[i].start;
+        pos = ss[i].end;
+    }
+    ok = ok == true && pos == ss[0].total;
+
+    uint8_t *buf = malloc(RSA_BUFFER_SIZE);
+    ok = ok == true && buf != NULL;
+    for (uint64_t i = 0; ok == true && i < count; i++) {
+        uint64_t nbytes = fread(buf, 1, RSA_BUFFER_SIZE, ss[i].file);
+        while (ok == true && nbytes != 0) {
+            ok = fwrite(buf, 1, nbytes, outfile) == nbytes;
+            nbytes = fread(buf, 1, RSA_BUFFER_SIZE, ss[i].file);
+        }
+        ok = ok == true && ferror(ss[i].file) == 0;
+    }
+
+    free(buf);
+    free(ss);
+    return ok == true && fflush(outfile) == 0;
+}
+
 // Function to produce a signature s using mpz_t's m, d, and n.
 //
 // Returns nothing, just passes the value of the signature out through s.
@@ -224,3 +816,50 @@ bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
         return false;
     }
 }
+
+// Function to hash infile and place the digest into mpz_t m. The digest
+// is never reduced mod n, so n must have at least RSA_DIGEST_MIN_BITS
+// bits for every bit of it to be signed.
+//
+// Returns true if the file was hashed, false if n is too small or the
+// file couldn't be read.
+static bool rsa_digest_file(mpz_t m, FILE *infile, mpz_t n, uint64_t nthreads) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    if (mpz_sizeinbase(n, 2) < RSA_DIGEST_MIN_BITS
+        || sha256_tree_file(digest, infile, nthreads) == false) {
+        return false;
+    }
+    mpz_import(m, SHA256_DIGEST_SIZE, 1, 1, 1, 0, digest);
+    return true;
+}
+
+// Function to produce a signature s of the contents of infile using
+// mpz_t's d and n. The file is hashed with nthreads threads.
+//
+// Returns true if the file was signed, false if it couldn't be read.
+bool rsa_sign_file(mpz_t s, FILE *infile, mpz_t d, mpz_t n, uint64_t nthreads) {
+    mpz_t m;
+    mpz_init(m);
+
+    bool ok = rsa_digest_file(m, infile, n, nthreads);
+    if (ok == true) {
+        rsa_sign(s, m, d, n);
+    }
+
+    mpz_clear(m);
+    return ok;
+}
+
+// Function to verify a signature s of the contents of infile using
+// mpz_t's e and n. The file is hashed with nthreads threads.
+//
+// Returns true if the signature is verified, false if it isn't.
+bool rsa_verify_file(FILE *infile, mpz_t s, mpz_t e, mpz_t n, uint64_t nthreads) {
+    mpz_t m;
+    mpz_init(m);
+
+    bool ok = rsa_digest_file(m, infile, n, nthreads) && rsa_verify(m, s, e, n);
+
+    mpz_clear(m);
+    return ok;
+}
@@ -1,10 +1,43 @@
 #pragma once
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <gmp.h>
 
+// Size of the chunks read by rsa_encrypt_file_multi.
+#define RSA_BUFFER_SIZE (1 << 20)
+
+// Flags carried in the header line of an encrypted file.
+#define RSA_FLAG_INDEX 0x1
+#define RSA_FLAG_LZ    0x2
+
+// Fixed width lines of the block index in an indexed container.
+#define RSA_INDEX_HEADER       "#index %016" PRIx64 " %016" PRIx64 "\n"
+#define RSA_INDEX_HEADER_SCAN  "#index %" SCNx64 " %" SCNx64 "\n"
+#define RSA_INDEX_HEADER_SIZE  41
+#define RSA_INDEX_ENTRY        "%016" PRIx64 " %016" PRIx64 "\n"
+#define RSA_INDEX_ENTRY_SIZE   34
+#define RSA_INDEX_FOOTER       "#end %016" PRIx64 "\n"
+#define RSA_INDEX_FOOTER_SCAN  "#end %" SCNx64 "\n"
+#define RSA_INDEX_FOOTER_SIZE  22
+
+// Header line of a shard, giving its kind ("enc" or "dec"), the ids of
+// the input and the key, the range of the input it covers and the size
+// of the whole input. Each id is a hex prefix of a SHA-256 digest.
+#define RSA_SHARD_ID_SIZE     33
+#define RSA_SHARD_HEADER      "#rsa shard %s %s %s %" PRIu64 " %" PRIu64 " %" PRIu64 "\n"
+#define RSA_SHARD_HEADER_SCAN "#rsa shard %3s %32s %32s %" SCNu64 " %" SCNu64 " %" SCNu64
+
+// Number and size of the chunks of the input hashed into a shard's id.
+#define RSA_SHARD_SAMPLES 16
+#define RSA_SHARD_CHUNK   (1 << 12)
+
+// Fewest bits a modulus needs to sign a SHA-256 digest whole: any such
+// modulus is at least 2^256, and so larger than every digest.
+#define RSA_DIGEST_MIN_BITS 257
+
 void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits, uint64_t iters);
 
 void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
@@ -25,6 +58,33 @@ void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n);
 
 void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
 
+bool rsa_encrypt_file_multi(FILE *infile, FILE *outfiles[], mpz_ptr n[], mpz_ptr e[],
+    uint64_t count, uint64_t bufsize);
+
+uint64_t rsa_write_header(FILE *outfile, uint32_t flags);
+
+uint32_t rsa_read_header(FILE *infile);
+
+bool rsa_encrypt_file_indexed(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+
+bool rsa_decrypt_range(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t d, uint64_t start, uint64_t len);
+
+bool rsa_shard_bounds(
+    FILE *infile, uint64_t index, uint64_t count, uint64_t *start, uint64_t *end);
+
+bool rsa_encrypt_shard(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t e, uint64_t start, uint64_t end);
+
+bool rsa_decrypt_shard(
+    FILE *infile, FILE *outfile, mpz_t n, mpz_t d, uint64_t start, uint64_t end);
+
+bool rsa_merge_shards(FILE *shards[], uint64_t count, FILE *outfile);
+
 void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n);
 
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n);
+
+bool rsa_sign_file(mpz_t s, FILE *infile, mpz_t d, mpz_t n, uint64_t nthreads);
+
+bool rsa_verify_file(FILE *infile, mpz_t s, mpz_t e, mpz_t n, uint64_t nthreads);
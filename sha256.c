@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "jobs.h"
+#include "sha256.h"
+
+static const uint32_t K[64] = { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+    0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74,
+    0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+    0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3,
+    0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354,
+    0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+    0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3,
+    0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa,
+    0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Function to run the SHA-256 compression function over one
+// 64 byte block, updating the hash state in ctx.
+static void sha256_block(sha256_ctx *ctx, const uint8_t *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t) block[4 * i] << 24 | (uint32_t) block[4 * i + 1] << 16
+               | (uint32_t) block[4 * i + 2] << 8 | (uint32_t) block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = ctx->h[0], b = ctx->h[1], c = ctx->h[2], d = ctx->h[3];
+    uint32_t e = ctx->h[4], f = ctx->h[5], g = ctx->h[6], h = ctx->h[7];
+
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+        uint32_t t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    ctx->h[0] += a;
+    ctx->h[1] += b;
+    ctx->h[2] += c;
+    ctx->h[3] += d;
+    ctx->h[4] += e;
+    ctx->h[5] += f;
+    ctx->h[6] += g;
+    ctx->h[7] += h;
+}
+
+// Function to initialize a hash context.
+void sha256_init(sha256_ctx *ctx) {
+    static const uint32_t iv[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f,
+        0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(ctx->h, iv, sizeof(iv));
+    ctx->len = 0;
+    ctx->fill = 0;
+}
+
+// Function to feed len bytes of data into the hash context.
+void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len) {
+    ctx->len += len;
+
+    if (ctx->fill > 0) {
+        size_t take = 64 - ctx->fill;
+        if (take > len) {
+            take = len;
+        }
+        memcpy(&ctx->buf[ctx->fill], data, take);
+        ctx->fill += take;
+        data += take;
+        len -= take;
+        if (ctx->fill < 64) {
+            return;
+        }
+        sha256_block(ctx, ctx->buf);
+        ctx->fill = 0;
+    }
+
+    while (len >= 64) {
+        sha256_block(ctx, data);
+        data += 64;
+        len -= 64;
+    }
+
+    memcpy(ctx->buf, data, len);
+    ctx->fill = len;
+}
+
+// Function to pad the message and write the 32 byte digest.
+void sha256_final(sha256_ctx *ctx, uint8_t digest[]) {
+    uint64_t bits = ctx->len * 8;
+
+    ctx->buf[ctx->fill++] = 0x80;
+    if (ctx->fill > 56) {
+        memset(&ctx->buf[ctx->fill], 0, 64 - ctx->fill);
+        sha256_block(ctx, ctx->buf);
+        ctx->fill = 0;
+    }
+    memset(&ctx->buf[ctx->fill], 0, 56 - ctx->fill);
+    for (int i = 0; i < 8; i++) {
+        ctx->buf[56 + i] = (uint8_t) (bits >> (56 - 8 * i));
+    }
+    sha256_block(ctx, ctx->buf);
+
+    for (int i = 0; i < 8; i++) {
+        digest[4 * i] = (uint8_t) (ctx->h[i] >> 24);
+        digest[4 * i + 1] = (uint8_t) (ctx->h[i] >> 16);
+        digest[4 * i + 2] = (uint8_t) (ctx->h[i] >> 8);
+        digest[4 * i + 3] = (uint8_t) ctx->h[i];
+    }
+}
+
+// Function to hash a single buffer in one call.
+void sha256(uint8_t digest[], const uint8_t *data, size_t len) {
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+// Function to hash one leaf of the tree. Leaves are prefixed with
+// a zero byte so they can never collide with the root.
+static void sha256_leaf(uint8_t digest[], const uint8_t *data, size_t len) {
+    static const uint8_t prefix = 0x00;
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, &prefix, 1);
+    sha256_update(&ctx, data, len);
+    sha256_final(&ctx, digest);
+}
+
+// Function to start the root hash, which covers every leaf digest
+// in order followed by the total length of the input.
+static void sha256_root_init(sha256_ctx *root) {
+    static const uint8_t prefix = 0x01;
+    sha256_init(root);
+    sha256_update(root, &prefix, 1);
+}
+
+static void sha256_root_final(sha256_ctx *root, uint64_t total, uint8_t digest[]) {
+    uint8_t len[8];
+    for (int i = 0; i < 8; i++) {
+        len[i] = (uint8_t) (total >> (56 - 8 * i));
+    }
+    sha256_update(root, len, 8);
+    sha256_final(root, digest);
+}
+
+typedef struct {
+    const uint8_t *data;
+    uint64_t size;
+    uint64_t nchunks;
+    uint64_t first;
+    uint64_t stride;
+    uint8_t *leaves;
+} leaf_job;
+
+// Worker thread which hashes every stride'th chunk starting at first.
+static void *sha256_leaf_worker(void *arg) {
+    leaf_job *job = arg;
+    for (uint64_t i = job->first; i < job->nchunks; i += job->stride) {
+        uint64_t off = i * SHA256_CHUNK_SIZE;
+        uint64_t len = job->size - off;
+        if (len > SHA256_CHUNK_SIZE) {
+            len = SHA256_CHUNK_SIZE;
+        }
+        sha256_leaf(&job->leaves[i * SHA256_DIGEST_SIZE], &job->data[off], len);
+    }
+    return NULL;
+}
+
+// Function to hash a mapped region, splitting the chunks across
+// nthreads workers.
+static bool sha256_tree_mapped(
+    uint8_t digest[], const uint8_t *data, uint64_t size, uint64_t nthreads) {
+    uint64_t nchunks = (size + SHA256_CHUNK_SIZE - 1) / SHA256_CHUNK_SIZE;
+    if (nthreads > nchunks) {
+        nthreads = nchunks;
+    }
+    if (nthreads == 0) {
+        nthreads = 1;
+    }
+
+    uint8_t *leaves = calloc(nchunks + 1, SHA256_DIGEST_SIZE);
+    leaf_job *jobs = calloc(nthreads, sizeof(leaf_job));
+    if (leaves == NULL || jobs == NULL) {
+        free(leaves);
+        free(jobs);
+        return false;
+    }
+
+    for (uint64_t t = 0; t < nthreads; t++) {
+        jobs[t] = (leaf_job) { data, size, nchunks, t, nthreads, leaves };
+    }
+    run_jobs(sha256_leaf_worker, jobs, nthreads, sizeof(leaf_job));
+
+    sha256_ctx root;
+    sha256_root_init(&root);
+    sha256_update(&root, leaves, nchunks * SHA256_DIGEST_SIZE);
+    sha256_root_final(&root, size, digest);
+
+    free(leaves);
+    free(jobs);
+    return true;
+}
+
+// Function to hash a stream that cannot be mapped (such as a pipe),
+// one chunk at a time. Produces the same digest as the mapped path.
+static bool sha256_tree_stream(uint8_t digest[], FILE *infile) {
+    uint8_t *chunk = malloc(SHA256_CHUNK_SIZE);
+    if (chunk == NULL) {
+        return false;
+    }
+
+    sha256_ctx root;
+    sha256_root_init(&root);
+
+    uint64_t total = 0;
+    uint8_t leaf[SHA256_DIGEST_SIZE];
+    size_t nbytes = fread(chunk, 1, SHA256_CHUNK_SIZE, infile);
+    while (nbytes != 0) {
+        sha256_leaf(leaf, chunk, nbytes);
+        sha256_update(&root, leaf, SHA256_DIGEST_SIZE);
+        total += nbytes;
+        nbytes = fread(chunk, 1, SHA256_CHUNK_SIZE, infile);
+    }
+    sha256_root_final(&root, total, digest);
+
+    free(chunk);
+    return ferror(infile) == 0;
+}
+
+// Function to hash the whole of infile as a two level tree: each
+// SHA256_CHUNK_SIZE chunk is a leaf, and the digest is the hash of
+// the leaves. Regular files are mapped and their leaves are hashed by
+// nthreads threads; anything else is read sequentially.
+//
+// Returns true on success, false if the file could not be read.
+bool sha256_tree_file(uint8_t digest[], FILE *infile, uint64_t nthreads) {
+    struct stat st;
+    int fd = fileno(infile);
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return sha256_tree_stream(digest, infile);
+    }
+
+    uint64_t size = st.st_size;
+    if (size == 0) {
+        return sha256_tree_mapped(digest, NULL, 0, 1);
+    }
+
+    uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return sha256_tree_stream(digest, infile);
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+
+    bool ok = sha256_tree_mapped(digest, data, size, nthreads);
+    munmap(data, size);
+    return ok;
+}
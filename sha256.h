@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Size of each leaf when hashing a file as a tree.
+#define SHA256_CHUNK_SIZE (1 << 22)
+
+typedef struct {
+    uint32_t h[8];
+    uint64_t len;
+    uint8_t buf[64];
+    size_t fill;
+} sha256_ctx;
+
+void sha256_init(sha256_ctx *ctx);
+
+void sha256_update(sha256_ctx *ctx, const uint8_t *data, size_t len);
+
+void sha256_final(sha256_ctx *ctx, uint8_t digest[]);
+
+void sha256(uint8_t digest[], const uint8_t *data, size_t len);
+
+bool sha256_tree_file(uint8_t digest[], FILE *infile, uint64_t nthreads);
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sha256.h"
+
+// Known answers for sha256() from FIPS 180-2, and for sha256_tree_file()
+// computed independently from the tree's definition: the leaves are
+// SHA-256(0x00 || chunk), and the root is SHA-256(0x01 || leaves ||
+// the input length as a big endian uint64_t).
+#define ABC        "abc"
+#define ABC_448    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+#define EMPTY_HASH "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+#define ABC_HASH   "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"
+#define ABC_448_HASH                                                                          \
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+#define MILLION_A_HASH                                                                        \
+    "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"
+#define TREE_EMPTY_HASH                                                                       \
+    "a536aa3cede6ea3c1f3e0357c3c60e0f216a8c89b853df13b29daa8f85065dfb"
+#define TREE_ABC_HASH                                                                         \
+    "e7ad7cf3cacb5ef9c2815d8db7b969bfe29fb553a867e7336656e0b8f1d64402"
+#define TREE_PATTERN_HASH                                                                     \
+    "aaf7fae17ccedfbd42733828076d62a14d0ec18a51e1ec1e8c1cdf9e8d578049"
+
+// Size of the patterned input: two whole chunks and part of a third.
+#define PATTERN_SIZE (2 * SHA256_CHUNK_SIZE + 5)
+
+static int failures = 0;
+
+// Helper function to compare a digest with its expected hex string,
+// reporting a mismatch under name.
+void check(const char *name, uint8_t digest[], const char *expected) {
+    char hex[2 * SHA256_DIGEST_SIZE + 1];
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(&hex[2 * i], 3, "%02x", digest[i]);
+    }
+    if (strcmp(hex, expected) != 0) {
+        fprintf(stderr, "FAIL %s: got %s, expected %s\n", name, hex, expected);
+        failures += 1;
+    }
+}
+
+// Helper function to tree hash len bytes of data, both as a regular
+// file on nthreads threads and as a stream, checking each digest.
+void check_tree(const char *name, const uint8_t *data, size_t len, const char *expected) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    char label[64];
+
+    FILE *file = tmpfile();
+    if (file == NULL || fwrite(data, 1, len, file) != len || fflush(file) != 0) {
+        perror("Failed");
+        exit(1);
+    }
+    for (uint64_t nthreads = 1; nthreads <= 4; nthreads++) {
+        rewind(file);
+        snprintf(label, sizeof(label), "%s (mapped, %lu threads)", name, (unsigned long) nthreads);
+        if (sha256_tree_file(digest, file, nthreads) == false) {
+            fprintf(stderr, "FAIL %s: unable to hash\n", label);
+            failures += 1;
+            continue;
+        }
+        check(label, digest, expected);
+    }
+    fclose(file);
+
+    // A memory stream has no descriptor, so it takes the streaming path.
+    // It can't be empty, so an empty input is a one byte stream with its
+    // byte already read.
+    FILE *stream = fmemopen((void *) data, len > 0 ? len : 1, "r");
+    snprintf(label, sizeof(label), "%s (stream)", name);
+    if (stream == NULL || (len == 0 && fgetc(stream) == EOF)
+        || sha256_tree_file(digest, stream, 1) == false) {
+        fprintf(stderr, "FAIL %s: unable to hash\n", label);
+        failures += 1;
+    } else {
+        check(label, digest, expected);
+    }
+    if (stream != NULL) {
+        fclose(stream);
+    }
+}
+
+// Main function. Checks the SHA-256 implementation against known
+// answers.
+// Returns 0 if every check passes, 1 otherwise.
+int main(void) {
+    uint8_t digest[SHA256_DIGEST_SIZE];
+
+    sha256(digest, (const uint8_t *) "", 0);
+    check("empty", digest, EMPTY_HASH);
+    sha256(digest, (const uint8_t *) ABC, strlen(ABC));
+    check("abc", digest, ABC_HASH);
+    sha256(digest, (const uint8_t *) ABC_448, strlen(ABC_448));
+    check("abc 448 bits", digest, ABC_448_HASH);
+
+    // The million a's are fed in uneven pieces, to cross block edges.
+    sha256_ctx ctx;
+    uint8_t *as = malloc(1000000);
+    memset(as, 'a', 1000000);
+    sha256_init(&ctx);
+    for (size_t off = 0, step = 1; off < 1000000; off += step, step = step % 97 + 13) {
+        sha256_update(&ctx, &as[off], off + step <= 1000000 ? step : 1000000 - off);
+    }
+    sha256_final(&ctx, digest);
+    check("million a", digest, MILLION_A_HASH);
+    free(as);
+
+    uint8_t *pattern = malloc(PATTERN_SIZE);
+    for (size_t i = 0; i < PATTERN_SIZE; i++) {
+        pattern[i] = (uint8_t) (i * 7 % 251);
+    }
+    check_tree("tree empty", (const uint8_t *) "", 0, TREE_EMPTY_HASH);
+    check_tree("tree abc", (const uint8_t *) ABC, strlen(ABC), TREE_ABC_HASH);
+    check_tree("tree pattern", pattern, PATTERN_SIZE, TREE_PATTERN_HASH);
+    free(pattern);
+
+    if (failures == 0) {
+        printf("sha256: all tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
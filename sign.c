@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "keyfile.h"
+#include "rsa.h"
+#include "tool.h"
+#include "tune.h"
+
+// Main function. Takes input from the command line.
+// Returns 0 upon successful run.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    bool verbose = false;
+    bool lock = false;
+    bool gotprvfile = false;
+    bool gotinfile = false;
+    bool gotoutfile = false;
+    uint64_t nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *pvfile;
+    FILE *infile;
+    FILE *outfile;
+
+    // Parse command line options.
+    while ((opt = getopt(argc, argv, "hvli:o:n:t:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Signs a file using an RSA private key.\n   Signatures are "
+                   "checked by the verify program.\n\nUSAGE\n   ./sign [-hv] [-i infile] [-o "
+                   "sigfile] [-n pvfile] [-t threads]\n\nOPTIONS\n   -h              Display "
+                   "program help and usage.\n   -v              Display verbose program output.\n"
+                   "   -i infile       Input file to sign (default: stdin).\n   -o sigfile      "
+                   "Output file for the signature (default: stdout).\n   -n pvfile       Private "
+                   "key file (default: rsa.priv).\n   -t threads      Threads used to hash the "
+                   "input (default: online CPUs).\n   -l              Lock key material in memory.\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'l': lock = true; break;
+        case 'i':
+            infile = fopen(optarg, "r");
+            if (infile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotinfile = true;
+            break;
+        case 'o':
+            outfile = fopen(optarg, "w");
+            if (outfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotoutfile = true;
+            break;
+        case 'n':
+            pvfile = fopen(optarg, "r");
+            if (pvfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotprvfile = true;
+            break;
+        case 't': nthreads = strtoull(optarg, NULL, 10); break;
+        }
+    }
+
+    // Shared setup: the memory pool, locked if requested since it will
+    // hold the private key, and the tuning file.
+    if (tool_init(lock) == false) {
+        return 1;
+    }
+
+    // Open the key files if they were not opened in getopt().
+    if (gotprvfile == false) {
+        pvfile = fopen("rsa.priv", "r");
+        if (pvfile == NULL) {
+            perror("Failed");
+            return 1;
+        }
+    }
+    if (gotinfile == false) {
+        infile = stdin;
+    }
+    if (gotoutfile == false) {
+        outfile = stdout;
+    }
+
+    // Read the key.
+    rsa_key key;
+    if (key_read(&key, pvfile) == false || key.priv == false) {
+        fprintf(stderr, "Unable to read private key.\n");
+        return 1;
+    }
+    if (key.nbits < RSA_DIGEST_MIN_BITS) {
+        fprintf(stderr, "Key is too small to sign a SHA-256 digest; it needs at least %d bits "
+                        "(keygen -b).\n",
+            RSA_DIGEST_MIN_BITS);
+        return 1;
+    }
+    tune_apply(key.nbits);
+
+    mpz_t s;
+    mpz_init(s);
+
+    // Hash and sign the input.
+    if (rsa_sign_file(s, infile, key.d, key.n, nthreads) == false) {
+        fprintf(stderr, "Unable to read input.\n");
+        return 1;
+    }
+    gmp_fprintf(outfile, "%Zx\n", s);
+
+    if (verbose == true) {
+        gmp_fprintf(stderr, "s (%zu bits) = %Zd\n", mpz_sizeinbase(s, 2), s);
+    }
+
+    // Termination.
+    fclose(pvfile);
+    if (gotinfile == true) {
+        fclose(infile);
+    }
+    if (gotoutfile == true) {
+        fclose(outfile);
+    }
+    key_clear(&key);
+    mpz_clear(s);
+}
@@ -0,0 +1,495 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "store.h"
+#include "rsa.h"
+#include "sha256.h"
+
+#define STORE_INDEX_FMT "%s %s %d %" PRId64 " %" PRIu64 " %s\n"
+
+// Function to build the path of a file inside the store.
+static void store_path(char path[], const char *dir, const char *name, const char *ext) {
+    snprintf(path, PATH_MAX, "%s/%s%s", dir, name, ext);
+}
+
+// Function to lock the store. Readers take a shared lock and writers an
+// exclusive one. If create is true, the store's directory is created if
+// needed; otherwise the store must already exist, with an index, so a
+// mistyped store name is reported rather than quietly made.
+//
+// Returns the locked descriptor, or -1 if the store couldn't be locked.
+static int store_lock(const char *dir, int op, bool create) {
+    char path[PATH_MAX];
+    if (create == true && mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    store_path(path, dir, "index", "");
+    if (create == false && access(path, R_OK) != 0) {
+        return -1;
+    }
+    store_path(path, dir, "lock", "");
+    int fd = open(path, create == true ? O_RDWR | O_CREAT : O_RDONLY, S_IRUSR | S_IWUSR);
+    if (fd >= 0 && flock(fd, op) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void store_unlock(int fd) {
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+// Function to read every entry of the store's index into a newly
+// allocated array. A missing index is an empty store.
+//
+// Returns the number of entries.
+static size_t store_load(const char *dir, store_entry **entries) {
+    char path[PATH_MAX];
+    store_path(path, dir, "index", "");
+    *entries = NULL;
+
+    FILE *index = fopen(path, "r");
+    if (index == NULL) {
+        return 0;
+    }
+
+    size_t count = 0, cap = 0;
+    char line[KEY_USER_MAX + STORE_FP_SIZE + PATH_MAX + 64];
+    while (fgets(line, sizeof(line), index) != NULL) {
+        if (count == cap) {
+            cap = cap != 0 ? 2 * cap : 16;
+            *entries = realloc(*entries, cap * sizeof(store_entry));
+        }
+
+        store_entry *entry = &(*entries)[count];
+        int verified, used = 0;
+        if (sscanf(line, "%255s %64s %d %" SCNd64 " %" SCNu64 " %n", entry->username,
+                entry->fingerprint, &verified, &entry->mtime, &entry->size, &used)
+                < 5
+            || used == 0) {
+            continue;
+        }
+        line[strcspn(line, "\n")] = '\0';
+        strncpy(entry->source, &line[used], PATH_MAX - 1);
+        entry->source[PATH_MAX - 1] = '\0';
+        entry->verified = verified != 0;
+        count += 1;
+    }
+
+    fclose(index);
+    return count;
+}
+
+// Function to replace the store's index with entries. The new index is
+// written beside the old one and renamed over it, so readers never see
+// a partial index.
+//
+// Returns true on success, false if the index couldn't be written.
+static bool store_save(const char *dir, store_entry *entries, size_t count) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    store_path(path, dir, "index", "");
+    store_path(tmp, dir, "index", ".tmp");
+
+    FILE *index = fopen(tmp, "w");
+    if (index == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        fprintf(index, STORE_INDEX_FMT, entries[i].username, entries[i].fingerprint,
+            entries[i].verified ? 1 : 0, entries[i].mtime, entries[i].size, entries[i].source);
+    }
+    bool ok = fclose(index) == 0;
+    return ok == true && rename(tmp, path) == 0;
+}
+
+// Function to compute the fingerprint of a key: the SHA-256 of n and e,
+// each preceded by its length, as a hex string. It doesn't depend on
+// which format the key was read from.
+void store_fingerprint(char fingerprint[], rsa_key *key) {
+    mpz_ptr vals[2] = { key->n, key->e };
+    sha256_ctx ctx;
+    sha256_init(&ctx);
+
+    for (int i = 0; i < 2; i++) {
+        size_t len = (mpz_sizeinbase(vals[i], 2) + 7) / 8;
+        uint8_t *bytes = calloc(len + 1, sizeof(uint8_t));
+        uint8_t prefix[8];
+        size_t count = 0;
+        mpz_export(bytes, &count, 1, 1, 1, 0, vals[i]);
+        for (int j = 0; j < 8; j++) {
+            prefix[j] = (uint8_t) ((uint64_t) count >> (56 - 8 * j));
+        }
+        sha256_update(&ctx, prefix, sizeof(prefix));
+        sha256_update(&ctx, bytes, count);
+        free(bytes);
+    }
+
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_final(&ctx, digest);
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(&fingerprint[2 * i], 3, "%02x", digest[i]);
+    }
+}
+
+// Function to write a binary copy of a key into the store, named by its
+// fingerprint: <fingerprint>.key for a public key and <fingerprint>.priv,
+// readable only by its owner, for a private key.
+//
+// Returns true if the key was written, false if it wasn't.
+bool store_write_key(const char *dir, rsa_key *key, const char *fingerprint) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    if (mkdir(dir, S_IRWXU) != 0 && errno != EEXIST) {
+        return false;
+    }
+    store_path(path, dir, fingerprint, key->priv == true ? ".priv" : ".key");
+    store_path(tmp, dir, fingerprint, key->priv == true ? ".priv.tmp" : ".key.tmp");
+
+    FILE *keyfile = fopen(tmp, "w");
+    if (keyfile == NULL) {
+        return false;
+    }
+    if (key->priv == true) {
+        fchmod(fileno(keyfile), S_IRUSR | S_IWUSR);
+    }
+    bool ok = key_write_bin(key, keyfile);
+    ok = fclose(keyfile) == 0 && ok == true;
+    return ok == true && rename(tmp, path) == 0;
+}
+
+// Function to find the slot of set holding fingerprint, or the empty
+// slot it would go in. Fingerprints are hex SHA-256 digests, so their
+// leading digits already make a good hash.
+static size_t store_fp_slot(store_fp_set *set, const char *fingerprint) {
+    char lead[17];
+    memcpy(lead, fingerprint, 16);
+    lead[16] = '\0';
+    size_t i = strtoull(lead, NULL, 16) & (set->cap - 1);
+    while (set->slots[i][0] != '\0' && strcmp(set->slots[i], fingerprint) != 0) {
+        i = (i + 1) & (set->cap - 1);
+    }
+    return i;
+}
+
+// Function to add fingerprint to set, unless it is already there.
+//
+// Returns true if it was added, false if it was already in the set.
+bool store_fp_set_add(store_fp_set *set, const char *fingerprint) {
+    size_t i = store_fp_slot(set, fingerprint);
+    if (set->slots[i][0] != '\0') {
+        return false;
+    }
+    strncpy(set->slots[i], fingerprint, STORE_FP_SIZE - 1);
+    set->count += 1;
+    return true;
+}
+
+// Function to fill set with the fingerprint of every entry of the
+// store's index, with room for extra more. Only the fingerprints are
+// read, so this stays cheap on large stores, and a missing store is an
+// empty set.
+//
+// Returns true on success, false if memory couldn't be allocated.
+bool store_fp_set_load(store_fp_set *set, const char *dir, size_t extra) {
+    *set = (store_fp_set) { NULL, 0, 0 };
+    char (*fps)[STORE_FP_SIZE] = NULL;
+    size_t count = 0, cap = 0;
+
+    int lock = store_lock(dir, LOCK_SH, false);
+    if (lock >= 0) {
+        char path[PATH_MAX];
+        store_path(path, dir, "index", "");
+        FILE *index = fopen(path, "r");
+        char line[KEY_USER_MAX + STORE_FP_SIZE + PATH_MAX + 64];
+        while (index != NULL && fgets(line, sizeof(line), index) != NULL) {
+            if (count == cap) {
+                cap = cap != 0 ? 2 * cap : 16;
+                fps = realloc(fps, cap * STORE_FP_SIZE);
+            }
+            if (sscanf(line, "%*255s %64s", fps[count]) == 1 && strlen(fps[count]) >= 16) {
+                count += 1;
+            }
+        }
+        if (index != NULL) {
+            fclose(index);
+        }
+        store_unlock(lock);
+    }
+
+    // Kept at most half full, so probes stay short.
+    set->cap = 16;
+    while (set->cap < 2 * (count + extra)) {
+        set->cap *= 2;
+    }
+    set->slots = calloc(set->cap, STORE_FP_SIZE);
+    for (size_t i = 0; set->slots != NULL && i < count; i++) {
+        store_fp_set_add(set, fps[i]);
+    }
+    free(fps);
+    return set->slots != NULL;
+}
+
+// Function to free the fingerprints held by set.
+void store_fp_set_clear(store_fp_set *set) {
+    free(set->slots);
+    *set = (store_fp_set) { NULL, 0, 0 };
+}
+
+// Function to append entries to the store's index, for keys that are
+// already in the store and known to be new, such as freshly generated
+// ones checked against a store_fp_set. Unlike store_add, the index isn't
+// read or rewritten.
+//
+// Returns true if the entries were appended, false otherwise.
+bool store_append(const char *dir, store_entry *entries, size_t count) {
+    int lock = store_lock(dir, LOCK_EX, true);
+    if (lock < 0) {
+        return false;
+    }
+
+    char path[PATH_MAX];
+    store_path(path, dir, "index", "");
+    FILE *index = fopen(path, "a");
+    bool ok = index != NULL;
+    for (size_t i = 0; ok == true && i < count; i++) {
+        ok = fprintf(index, STORE_INDEX_FMT, entries[i].username, entries[i].fingerprint,
+                 entries[i].verified ? 1 : 0, entries[i].mtime, entries[i].size,
+                 entries[i].source)
+             > 0;
+    }
+    if (index != NULL) {
+        ok = fclose(index) == 0 && ok == true;
+    }
+
+    store_unlock(lock);
+    return ok;
+}
+
+// Function to read a public key file, check its username signature and
+// keep a binary copy of it in the store. Fills in entry for the index.
+//
+// Returns true if the key was stored, even if it failed verification,
+// and false if it couldn't be read or written.
+static bool store_import(const char *dir, const char *keypath, store_entry *entry) {
+    struct stat st;
+    memset(entry, 0, sizeof(store_entry));
+    if (realpath(keypath, entry->source) == NULL || stat(entry->source, &st) != 0) {
+        return false;
+    }
+    entry->mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    entry->size = st.st_size;
+
+    FILE *pbfile = fopen(entry->source, "r");
+    if (pbfile == NULL) {
+        return false;
+    }
+    rsa_key key;
+    bool ok = key_read(&key, pbfile);
+    fclose(pbfile);
+    if (ok == false || key.priv == true) {
+        if (ok == true) {
+            key_clear(&key);
+        }
+        return false;
+    }
+
+    strncpy(entry->username, key.username, KEY_USER_MAX - 1);
+    store_fingerprint(entry->fingerprint, &key);
+
+    // The same check encrypt makes before using a key.
+    mpz_t user;
+    mpz_init(user);
+    mpz_set_str(user, key.username, 62);
+    entry->verified = rsa_verify(user, key.s, key.e, key.n);
+    mpz_clear(user);
+
+    ok = store_write_key(dir, &key, entry->fingerprint);
+    key_clear(&key);
+    return ok;
+}
+
+// Function to add a public key file to the store at dir. It replaces
+// any entry with the same fingerprint, and any entry read from the same
+// source file, since that file now holds this key. The key's username
+// signature is checked once here, and the result is recorded in the index.
+//
+// Returns true if the key was added, false if it couldn't be.
+bool store_add(const char *dir, const char *keypath, store_entry *entry) {
+    int lock = store_lock(dir, LOCK_EX, true);
+    if (lock < 0) {
+        return false;
+    }
+
+    bool ok = store_import(dir, keypath, entry);
+    if (ok == true) {
+        store_entry *entries;
+        size_t count = store_load(dir, &entries);
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (strcmp(entries[i].fingerprint, entry->fingerprint) == 0) {
+                continue;
+            }
+            if (strcmp(entries[i].source, entry->source) == 0) {
+                char path[PATH_MAX];
+                store_path(path, dir, entries[i].fingerprint, ".key");
+                unlink(path);
+                continue;
+            }
+            entries[kept++] = entries[i];
+        }
+        entries = realloc(entries, (kept + 1) * sizeof(store_entry));
+        entries[kept] = *entry;
+        ok = store_save(dir, entries, kept + 1);
+        free(entries);
+    }
+
+    store_unlock(lock);
+    return ok;
+}
+
+// Function to check whether an entry is selected by name, which is
+// either a username or at least 8 leading characters of a fingerprint.
+static bool store_match(store_entry *entry, const char *name) {
+    size_t len = strlen(name);
+    return strcmp(entry->username, name) == 0
+           || (len >= 8 && strncmp(entry->fingerprint, name, len) == 0);
+}
+
+// Function to remove every key selected by name from the store.
+//
+// Returns true if any key was removed, false otherwise.
+bool store_remove(const char *dir, const char *name) {
+    int lock = store_lock(dir, LOCK_EX, false);
+    if (lock < 0) {
+        return false;
+    }
+
+    store_entry *entries;
+    size_t count = store_load(dir, &entries);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (store_match(&entries[i], name) == true) {
+            char path[PATH_MAX];
+            store_path(path, dir, entries[i].fingerprint, ".key");
+            unlink(path);
+            store_path(path, dir, entries[i].fingerprint, ".priv");
+            unlink(path);
+        } else {
+            entries[kept++] = entries[i];
+        }
+    }
+
+    bool ok = kept < count && store_save(dir, entries, kept);
+    free(entries);
+    store_unlock(lock);
+    return ok;
+}
+
+// Function to print every key in the store to outfile.
+//
+// Returns true if the store could be read, false otherwise.
+bool store_list(const char *dir, FILE *outfile) {
+    int lock = store_lock(dir, LOCK_SH, false);
+    if (lock < 0) {
+        return false;
+    }
+
+    store_entry *entries;
+    size_t count = store_load(dir, &entries);
+    for (size_t i = 0; i < count; i++) {
+        fprintf(outfile, "%-16s %.16s %-10s %s\n", entries[i].username, entries[i].fingerprint,
+            entries[i].verified ? "verified" : "unverified",
+            entries[i].source[0] != '\0' ? entries[i].source : "(generated)");
+    }
+
+    free(entries);
+    store_unlock(lock);
+    return true;
+}
+
+// Function to read every entry of the store into a newly allocated
+// array, which the caller frees, and set count to their number.
+//
+// Returns true if the store was read, false if it doesn't exist or
+// couldn't be locked.
+bool store_entries(const char *dir, store_entry **entries, size_t *count) {
+    *entries = NULL;
+    *count = 0;
+    int lock = store_lock(dir, LOCK_SH, false);
+    if (lock < 0) {
+        return false;
+    }
+    *count = store_load(dir, entries);
+    store_unlock(lock);
+    return true;
+}
+
+// Function to read the stored copy of the key with the given full
+// fingerprint, whether or not its signature was verified.
+//
+// Returns true if the key was read, false otherwise.
+bool store_read_key(const char *dir, const char *fingerprint, rsa_key *key) {
+    char path[PATH_MAX];
+    store_path(path, dir, fingerprint, ".key");
+    FILE *keyfile = fopen(path, "r");
+    if (keyfile == NULL) {
+        return false;
+    }
+    bool ok = key_read(key, keyfile);
+    fclose(keyfile);
+    return ok;
+}
+
+// Function to open the key selected by name from the store. When a name
+// matches more than one key, the most recently added one is used. If the
+// key's source file has changed since it was added, it is imported and
+// verified again; otherwise the stored binary copy is mapped and no
+// verification is repeated.
+//
+// Returns true if a verified key was opened, false otherwise.
+bool store_open_key(const char *dir, const char *name, rsa_key *key, store_entry *entry) {
+    int lock = store_lock(dir, LOCK_SH, false);
+    if (lock < 0) {
+        return false;
+    }
+
+    store_entry *entries;
+    size_t count = store_load(dir, &entries);
+    bool found = false;
+    for (size_t i = count; i > 0 && found == false; i--) {
+        if (store_match(&entries[i - 1], name) == true) {
+            *entry = entries[i - 1];
+            found = true;
+        }
+    }
+    free(entries);
+    store_unlock(lock);
+
+    if (found == false) {
+        return false;
+    }
+
+    // Generated keys have no source, and a source that is gone leaves
+    // the stored copy in use.
+    struct stat st;
+    if (entry->source[0] != '\0' && stat(entry->source, &st) == 0
+        && (st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec != entry->mtime
+            || (uint64_t) st.st_size != entry->size)) {
+        char source[PATH_MAX];
+        strcpy(source, entry->source);
+        if (store_add(dir, source, entry) == false) {
+            return false;
+        }
+    }
+    if (entry->verified == false) {
+        return false;
+    }
+    return store_read_key(dir, entry->fingerprint, key);
+}
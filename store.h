@@ -0,0 +1,54 @@
+#pragma once
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "keyfile.h"
+
+#define STORE_FP_SIZE 65
+
+// One line of a key store's index. The key itself is kept next to the
+// index in the binary format, as <fingerprint>.key, along with the
+// private key as <fingerprint>.priv for keys generated into the store.
+// Generated keys have an empty source.
+typedef struct {
+    char username[KEY_USER_MAX];
+    char fingerprint[STORE_FP_SIZE];
+    bool verified; // Whether the username signature has been checked.
+    int64_t mtime; // Modification time of the source, in nanoseconds.
+    uint64_t size; // Size of the source, in bytes.
+    char source[PATH_MAX];
+} store_entry;
+
+// A set of fingerprints, such as those already in a store's index.
+typedef struct {
+    char (*slots)[STORE_FP_SIZE];
+    size_t cap;
+    size_t count;
+} store_fp_set;
+
+void store_fingerprint(char fingerprint[], rsa_key *key);
+
+bool store_fp_set_load(store_fp_set *set, const char *dir, size_t extra);
+
+bool store_fp_set_add(store_fp_set *set, const char *fingerprint);
+
+void store_fp_set_clear(store_fp_set *set);
+
+bool store_write_key(const char *dir, rsa_key *key, const char *fingerprint);
+
+bool store_append(const char *dir, store_entry *entries, size_t count);
+
+bool store_add(const char *dir, const char *keypath, store_entry *entry);
+
+bool store_remove(const char *dir, const char *name);
+
+bool store_list(const char *dir, FILE *outfile);
+
+bool store_entries(const char *dir, store_entry **entries, size_t *count);
+
+bool store_read_key(const char *dir, const char *fingerprint, rsa_key *key);
+
+bool store_open_key(const char *dir, const char *name, rsa_key *key, store_entry *entry);
@@ -0,0 +1,23 @@
+#include <stdio.h>
+
+#include "pool.h"
+#include "tool.h"
+#include "tune.h"
+
+// Function to set up what every program shares, before any GMP value is
+// made: GMP's allocations are routed through the pool, locked in memory
+// if lock_memory is true, and the tuning file written by calibrate is
+// read if there is one. A tuning file that can't be read only leaves
+// the settings at their defaults.
+//
+// Returns true on success, false if memory couldn't be locked.
+bool tool_init(bool lock_memory) {
+    if (pool_init(lock_memory) == false) {
+        perror("Unable to lock memory");
+        return false;
+    }
+    if (tune_load(NULL) == false) {
+        fprintf(stderr, "Unable to read tuning file.\n");
+    }
+    return true;
+}
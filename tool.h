@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdbool.h>
+
+bool tool_init(bool lock_memory);
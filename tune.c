@@ -0,0 +1,301 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "jobs.h"
+#include "numtheory.h"
+#include "pool.h"
+#include "tune.h"
+
+// Candidate I/O buffer sizes, starting with stdio's own (0), and the
+// amount of input used to time them.
+static const uint64_t bufsizes[] = { 0, 1 << 12, 1 << 16, 1 << 20 };
+#define TUNE_BUF_INPUT (1 << 22)
+
+// Exponentiations timed per thread, and repeats of each measurement.
+#define TUNE_REPS   4
+#define TUNE_ROUNDS 5
+
+// How much faster a window, thread count or buffer size must be than the
+// best so far to be taken, so that noise doesn't pick it.
+#define TUNE_MARGIN 0.95
+
+// Entries of the tuning file in use. Read once at startup, before any
+// threads are started.
+static tune_entry entries[TUNE_MAX_ENTRIES];
+static uint64_t nentries = 0;
+
+// Function to read the tuning file at path, or if path is NULL, the file
+// named by RSA_TUNE or else rsa.tune. A missing default file just leaves
+// every setting at its default.
+//
+// Returns true if the settings were read, false if a named file couldn't
+// be read or held no valid entries.
+bool tune_load(const char *path) {
+    bool named = path != NULL || getenv(TUNE_ENV) != NULL;
+    if (path == NULL) {
+        path = getenv(TUNE_ENV) != NULL ? getenv(TUNE_ENV) : TUNE_FILE;
+    }
+
+    FILE *tunefile = fopen(path, "r");
+    if (tunefile == NULL) {
+        return named == false;
+    }
+
+    char line[256];
+    nentries = 0;
+    while (nentries < TUNE_MAX_ENTRIES && fgets(line, sizeof(line), tunefile) != NULL) {
+        tune_entry *entry = &entries[nentries];
+        if (line[0] != '#'
+            && sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64, &entry->bits,
+                   &entry->window, &entry->threads, &entry->bufsize)
+                   == 4) {
+            nentries += 1;
+        }
+    }
+    fclose(tunefile);
+    return nentries > 0;
+}
+
+// Function to find the settings for a modulus of the given size: those
+// measured at the nearest size in the tuning file. Without a tuning
+// file, pow_mod keeps its plain algorithm, workers match the online CPUs
+// and stdio buffers are left alone (a bufsize of 0).
+//
+// Returns the settings.
+tune_entry tune_lookup(uint64_t bits) {
+    tune_entry best = { bits, 1, sysconf(_SC_NPROCESSORS_ONLN), 0 };
+    uint64_t dist = UINT64_MAX;
+    for (uint64_t i = 0; i < nentries; i++) {
+        uint64_t d = entries[i].bits > bits ? entries[i].bits - bits : bits - entries[i].bits;
+        if (d < dist) {
+            best = entries[i];
+            dist = d;
+        }
+    }
+    if (best.threads == 0) {
+        best.threads = 1;
+    }
+    return best;
+}
+
+// Function to look up the settings for a modulus of the given size and
+// set pow_mod's window width from them.
+//
+// Returns the settings, for the caller to apply the rest of.
+tune_entry tune_apply(uint64_t bits) {
+    tune_entry entry = tune_lookup(bits);
+    pow_mod_set_window(entry.window);
+    return entry;
+}
+
+// Function to give file a buffer of the tuned size. It must be called
+// before anything is read from or written to file.
+void tune_buffer(FILE *file, tune_entry *entry) {
+    if (entry->bufsize != 0) {
+        setvbuf(file, NULL, _IOFBF, entry->bufsize);
+    }
+}
+
+// Operands of the exponentiations being timed.
+typedef struct {
+    mpz_ptr base;
+    mpz_ptr exp;
+    mpz_ptr n;
+} tune_job;
+
+// Worker thread which runs TUNE_REPS exponentiations.
+static void *tune_worker(void *arg) {
+    tune_job *job = arg;
+    mpz_t out;
+    mpz_init(out);
+    for (int i = 0; i < TUNE_REPS; i++) {
+        pow_mod(out, job->base, job->exp, job->n);
+    }
+    mpz_clear(out);
+    pool_thread_release();
+    return NULL;
+}
+
+// Function to time TUNE_REPS exponentiations on each of nthreads
+// threads, taking the best of TUNE_ROUNDS runs.
+//
+// Returns the seconds taken per exponentiation.
+static double tune_time(tune_job *job, uint64_t nthreads) {
+    double best = 0;
+    for (int round = 0; round < TUNE_ROUNDS; round++) {
+        double start = clock_now();
+        run_jobs(tune_worker, job, nthreads, 0);
+        double taken = (clock_now() - start) / (TUNE_REPS * nthreads);
+        best = (round == 0 || taken < best) ? taken : best;
+    }
+    return best;
+}
+
+// Function to time the I/O encrypt does for TUNE_BUF_INPUT bytes of
+// input with a modulus of the given size, with stdio buffers of bufsize
+// bytes (or stdio's own if bufsize is 0): reading the input a block at a
+// time and writing a line of hex for each block. The exponentiations are
+// left out, since they would swamp the difference buffering makes. Takes
+// the best of TUNE_ROUNDS runs.
+//
+// Returns the seconds taken, or 0 if the temporary files couldn't be made.
+static double tune_time_io(uint8_t *input, uint64_t bits, uint64_t bufsize) {
+    uint64_t ki = (bits - 1) / 8 - 1;
+    uint8_t *block = malloc(ki);
+    char *line = malloc(bits / 4 + 2);
+    if (block == NULL || line == NULL) {
+        free(block);
+        free(line);
+        return 0;
+    }
+    memset(line, 'f', bits / 4);
+    line[bits / 4] = '\n';
+    line[bits / 4 + 1] = '\0';
+
+    double best = 0;
+    for (int round = 0; round < TUNE_ROUNDS; round++) {
+        FILE *infile = tmpfile();
+        FILE *outfile = tmpfile();
+        if (infile == NULL || outfile == NULL) {
+            if (infile != NULL) {
+                fclose(infile);
+            }
+            if (outfile != NULL) {
+                fclose(outfile);
+            }
+            best = 0;
+            break;
+        }
+        if (bufsize != 0) {
+            setvbuf(infile, NULL, _IOFBF, bufsize);
+            setvbuf(outfile, NULL, _IOFBF, bufsize);
+        }
+        fwrite(input, 1, TUNE_BUF_INPUT, infile);
+        rewind(infile);
+
+        double start = clock_now();
+        while (fread(block, 1, ki, infile) != 0) {
+            fputs(line, outfile);
+        }
+        fflush(outfile);
+        double taken = clock_now() - start;
+        best = (round == 0 || taken < best) ? taken : best;
+
+        fclose(infile);
+        fclose(outfile);
+    }
+
+    free(block);
+    free(line);
+    return best;
+}
+
+// Function to measure the best settings for a modulus of the given size
+// on this machine, and store them in entry. Every window width is timed
+// on a private exponent sized exponentiation, then thread counts up to
+// maxthreads are timed for throughput with the best width, then each
+// buffer size is timed on encrypt's reads and writes. A window, thread
+// count or buffer size is only taken over the best so far if it is
+// clearly faster, so the plain algorithm, one thread and stdio's own
+// buffers are kept unless another setting beats them.
+//
+// Returns true on success, false if the measurements couldn't be made.
+bool tune_calibrate(tune_entry *entry, uint64_t bits, uint64_t maxthreads, bool verbose) {
+    gmp_randstate_t rs;
+    gmp_randinit_mt(rs);
+    gmp_randseed_ui(rs, bits);
+
+    mpz_t n, base, exp;
+    mpz_inits(n, base, exp, NULL);
+    mpz_urandomb(n, rs, bits);
+    mpz_setbit(n, bits - 1);
+    mpz_setbit(n, 0);
+    mpz_urandomm(base, rs, n);
+    mpz_urandomb(exp, rs, bits);
+    tune_job job = { base, exp, n };
+
+    *entry = (tune_entry) { bits, 1, 1, 0 };
+    bool ok = true;
+
+    // Window width, on one thread. Wider windows must be clearly faster,
+    // since each exponentiation takes little time on smaller keys.
+    double best = 0;
+    for (uint64_t w = 1; ok == true && w <= POW_MOD_MAX_WINDOW; w++) {
+        pow_mod_set_window(w);
+        double taken = tune_time(&job, 1);
+        ok = taken > 0;
+        if (verbose == true) {
+            printf("%" PRIu64 " bits: window %" PRIu64 ": %.3f ms\n", bits, w, taken * 1e3);
+        }
+        if (w == 1 || taken < best * TUNE_MARGIN) {
+            best = taken;
+            entry->window = w;
+        }
+    }
+    pow_mod_set_window(entry->window);
+
+    // Thread count, by throughput. More threads must be clearly faster
+    // per exponentiation to be worth taking.
+    best = 0;
+    uint64_t t = 1;
+    while (ok == true) {
+        double taken = tune_time(&job, t);
+        ok = taken > 0;
+        if (verbose == true) {
+            printf("%" PRIu64 " bits: %" PRIu64 " threads: %.3f ms\n", bits, t, taken * 1e3);
+        }
+        if (t == 1 || taken < best * TUNE_MARGIN) {
+            best = taken;
+            entry->threads = t;
+        }
+        if (t >= maxthreads) {
+            break;
+        }
+        t = 2 * t < maxthreads ? 2 * t : maxthreads;
+    }
+
+    // I/O buffer size.
+    uint8_t *input = malloc(TUNE_BUF_INPUT);
+    ok = ok == true && input != NULL;
+    for (uint64_t i = 0; ok == true && i < TUNE_BUF_INPUT; i++) {
+        input[i] = (uint8_t) gmp_urandomb_ui(rs, 8);
+    }
+    best = 0;
+    for (uint64_t i = 0; ok == true && i < sizeof(bufsizes) / sizeof(bufsizes[0]); i++) {
+        double taken = tune_time_io(input, bits, bufsizes[i]);
+        ok = taken > 0;
+        if (verbose == true) {
+            printf("%" PRIu64 " bits: buffer %" PRIu64 ": %.3f ms\n", bits, bufsizes[i],
+                taken * 1e3);
+        }
+        if (i == 0 || taken < best * TUNE_MARGIN) {
+            best = taken;
+            entry->bufsize = bufsizes[i];
+        }
+    }
+
+    pow_mod_set_window(1);
+    free(input);
+    mpz_clears(n, base, exp, NULL);
+    gmp_randclear(rs);
+    return ok;
+}
+
+// Function to write the count entries of list to the tuning file at path.
+//
+// Returns true if the file was written, false otherwise.
+bool tune_save(const char *path, tune_entry list[], uint64_t count) {
+    FILE *tunefile = fopen(path, "w");
+    if (tunefile == NULL) {
+        return false;
+    }
+    fprintf(tunefile, "# bits window threads bufsize\n");
+    for (uint64_t i = 0; i < count; i++) {
+        fprintf(tunefile, "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n", list[i].bits,
+            list[i].window, list[i].threads, list[i].bufsize);
+    }
+    return fclose(tunefile) == 0;
+}
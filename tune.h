@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Tuning file read at startup, unless RSA_TUNE names another.
+#define TUNE_FILE "rsa.tune"
+#define TUNE_ENV  "RSA_TUNE"
+
+// Most key sizes a tuning file can hold.
+#define TUNE_MAX_ENTRIES 64
+
+// The settings that suit one modulus size on this machine.
+typedef struct {
+    uint64_t bits; // Modulus size the settings were measured at.
+    uint64_t window; // Exponent window width for pow_mod.
+    uint64_t threads; // Worker threads for CPU bound work.
+    uint64_t bufsize; // Buffer size for file I/O.
+} tune_entry;
+
+bool tune_load(const char *path);
+
+tune_entry tune_lookup(uint64_t bits);
+
+tune_entry tune_apply(uint64_t bits);
+
+void tune_buffer(FILE *file, tune_entry *entry);
+
+bool tune_calibrate(tune_entry *entry, uint64_t bits, uint64_t maxthreads, bool verbose);
+
+bool tune_save(const char *path, tune_entry list[], uint64_t count);
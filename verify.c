@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "keyfile.h"
+#include "rsa.h"
+#include "tool.h"
+#include "tune.h"
+
+// Main function. Takes input from the command line.
+// Returns 0 if the signature is verified, 1 otherwise.
+//
+// Argc is the number of arguments passed.
+// Argv is a pointer array to the arguments.
+int main(int argc, char **argv) {
+    int opt = 0;
+    bool verbose = false;
+    bool gotpubfile = false;
+    bool gotinfile = false;
+    bool gotsigfile = false;
+    uint64_t nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *pbfile;
+    FILE *infile;
+    FILE *sigfile;
+
+    // Parse command line options.
+    while ((opt = getopt(argc, argv, "hvi:s:n:t:")) != -1) {
+        switch (opt) {
+        case 'h':
+            printf("SYNOPSIS\n   Verifies a file signature made by the sign program.\n\nUSAGE\n"
+                   "   ./verify [-hv] [-i infile] -s sigfile [-n pbfile] [-t threads]\n\nOPTIONS\n"
+                   "   -h              Display program help and usage.\n   -v              "
+                   "Display verbose program output.\n   -i infile       Input file to verify "
+                   "(default: stdin).\n   -s sigfile      Signature file written by sign.\n   -n "
+                   "pbfile       Public key file (default: rsa.pub).\n   -t threads      Threads "
+                   "used to hash the input (default: online CPUs).\n");
+            return 1;
+        case 'v': verbose = true; break;
+        case 'i':
+            infile = fopen(optarg, "r");
+            if (infile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotinfile = true;
+            break;
+        case 's':
+            sigfile = fopen(optarg, "r");
+            if (sigfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotsigfile = true;
+            break;
+        case 'n':
+            pbfile = fopen(optarg, "r");
+            if (pbfile == NULL) {
+                perror("Failed");
+                return 1;
+            }
+            gotpubfile = true;
+            break;
+        case 't': nthreads = strtoull(optarg, NULL, 10); break;
+        }
+    }
+
+    // Shared setup: the memory pool and the tuning file.
+    tool_init(false);
+
+    if (gotsigfile == false) {
+        fprintf(stderr, "A signature file is required (-s).\n");
+        return 1;
+    }
+
+    // Open the key files if they were not opened in getopt().
+    if (gotpubfile == false) {
+        pbfile = fopen("rsa.pub", "r");
+        if (pbfile == NULL) {
+            perror("Failed");
+            return 1;
+        }
+    }
+    if (gotinfile == false) {
+        infile = stdin;
+    }
+
+    // Read the key and the signature.
+    rsa_key key;
+    if (key_read(&key, pbfile) == false || key.priv == true) {
+        fprintf(stderr, "Unable to read public key.\n");
+        return 1;
+    }
+    if (key.nbits < RSA_DIGEST_MIN_BITS) {
+        fprintf(stderr, "Key is too small to sign a SHA-256 digest; it needs at least %d bits "
+                        "(keygen -b).\n",
+            RSA_DIGEST_MIN_BITS);
+        return 1;
+    }
+    tune_apply(key.nbits);
+
+    mpz_t sig;
+    mpz_init(sig);
+    if (gmp_fscanf(sigfile, "%Zx\n", sig) != 1) {
+        fprintf(stderr, "Unable to read signature.\n");
+        return 1;
+    }
+
+    if (verbose == true) {
+        printf("user = %s\n", key.username);
+    }
+
+    // Check the key's username signature, as encrypt does, so that only
+    // keys made by their owner's private key are trusted.
+    mpz_t user;
+    mpz_init(user);
+    mpz_set_str(user, key.username, 62);
+    if (rsa_verify(user, key.s, key.e, key.n) == false) {
+        printf("Key signature unable to be verified.\n");
+        return 1;
+    }
+    mpz_clear(user);
+
+    // Hash the input and check it against the signature.
+    bool verified = rsa_verify_file(infile, sig, key.e, key.n, nthreads);
+    if (verified == true) {
+        printf("Signature verified.\n");
+    } else {
+        printf("Signature unable to be verified.\n");
+    }
+
+    // Termination.
+    fclose(pbfile);
+    fclose(sigfile);
+    if (gotinfile == true) {
+        fclose(infile);
+    }
+    key_clear(&key);
+    mpz_clear(sig);
+    return verified == true ? 0 : 1;
+}